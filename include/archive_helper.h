@@ -1,10 +1,13 @@
 #ifndef _3D_SHELL_ARCHIVE_HELPER_H
 #define _3D_SHELL_ARCHIVE_HELPER_H
 
+#include <3ds.h>
 #include <string>
 
+#include "conflict.h"
+
 namespace ArchiveHelper {
-    int Extract(const std::string &path);
+    int Extract(FS_Archive dest_archive, const std::string &path, const std::string &dest_dir, ConflictPolicy policy);
 }
 
 #endif
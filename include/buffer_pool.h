@@ -0,0 +1,27 @@
+#ifndef _3D_SHELL_BUFFER_POOL_H
+#define _3D_SHELL_BUFFER_POOL_H
+
+#include <3ds.h>
+
+#include "io_tune.h"
+
+typedef struct {
+    u32 allocated = 0; // pooled buffers, in use or free
+    u32 in_use = 0;
+    u32 high_water = 0; // most pooled buffers in use at once
+    u32 checkouts = 0;
+    u32 overflows = 0; // checkouts that found the pool exhausted or were too big for it
+} BufferPoolStats;
+
+namespace BufferPool {
+    // Every bulk I/O buffer is this big, enough for the largest chunk IOTune hands out.
+    static const u32 buffer_size = IOTune::max_chunk_size;
+    
+    void Init(void);
+    void Exit(void);
+    u8 *Checkout(u32 size = buffer_size);
+    void Return(u8 *buf);
+    void GetStats(BufferPoolStats *stats);
+}
+
+#endif
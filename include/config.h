@@ -8,6 +8,13 @@ typedef struct {
 	int sort = 0;
 	bool dev_options = false;
 	bool dark_theme = false;
+	bool verify_copy = false;
+	bool use_trash = false;
+	int conflict_policy = 0;
+	int copy_durability = 2; // DurabilityMode for each DurabilityClass
+	int download_durability = 1;
+	int log_durability = 2;
+	int state_durability = 0;
 	std::string cwd;
 } config_t;
 
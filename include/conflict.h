@@ -0,0 +1,37 @@
+#ifndef _3D_SHELL_CONFLICT_H
+#define _3D_SHELL_CONFLICT_H
+
+#include <3ds.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "path_builder.h"
+#include "tree_walk.h"
+
+// What a paste, move or extraction does with a file the destination already has.
+typedef enum ConflictPolicy {
+    ConflictOverwrite,
+    ConflictSkip,
+    ConflictUpdate, // only overwritten by a newer or larger file
+    ConflictRename // the whole item goes alongside under a free name
+} ConflictPolicy;
+
+// The files already under a destination root, from one walk of it. Keyed by the same relative paths as a TreeManifest.
+typedef struct ConflictScan {
+    std::unordered_map<std::u16string, u64> files;
+    bool exists = false; // the root itself
+} ConflictScan;
+
+namespace Conflict {
+    const char *GetName(ConflictPolicy policy);
+    u64 GetModifiedTime(FS_Archive archive, const PathBuilder &path);
+    std::u16string GetFreeName(FS_Archive archive, const std::string &dir, const std::u16string &name, bool is_dir);
+    Result Scan(FS_Archive archive, PathBuilder &root, ConflictScan &scan);
+    bool Keep(ConflictPolicy policy, const ConflictScan &scan, const std::u16string &rel_path, u64 size, u64 src_time, FS_Archive dest_archive, 
+        const PathBuilder &dest_path);
+    Result Plan(FS_Archive src_archive, PathBuilder &src_path, FS_Archive dest_archive, PathBuilder &dest_path, const TreeManifest &manifest, 
+        ConflictPolicy policy, std::vector<u8> &skip);
+}
+
+#endif
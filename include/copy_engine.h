@@ -0,0 +1,19 @@
+#ifndef _3D_SHELL_COPY_ENGINE_H
+#define _3D_SHELL_COPY_ENGINE_H
+
+#include <3ds.h>
+#include <string>
+
+typedef struct {
+    u64 bytes = 0;
+    u64 elapsed = 0; // ms
+    bool cancelled = false;
+} CopyStats;
+
+namespace CopyEngine {
+    Result Copy(Handle src, Handle dest, u64 offset, u64 size, u32 direction, const std::string &name, u32 *crc, CopyStats *stats);
+    Result Checksum(Handle handle, u64 offset, u64 size, u32 *crc);
+    u64 GetThroughput(const CopyStats &stats);
+}
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef _3D_SHELL_COPY_PLAN_H
+#define _3D_SHELL_COPY_PLAN_H
+
+#include <3ds.h>
+#include <vector>
+
+#include "path_builder.h"
+#include "tree_walk.h"
+
+namespace CopyPlan {
+    Result CheckSpace(FS_Archive archive, const TreeManifest &manifest, const std::vector<u8> &skip);
+    void CreateDirs(FS_Archive archive, PathBuilder &dest_path, const TreeManifest &manifest);
+    Result Run(FS_Archive src_archive, FS_Archive dest_archive, const TreeManifest &manifest, const std::vector<u8> &skip, PathBuilder &src_path, 
+        PathBuilder &dest_path, bool move);
+    void RemoveDirs(FS_Archive archive, PathBuilder &src_path, const TreeManifest &manifest);
+}
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef _3D_SHELL_DIR_CACHE_H
+#define _3D_SHELL_DIR_CACHE_H
+
+#include <3ds.h>
+#include <string>
+
+#include "dir_list.h"
+
+namespace DirCache {
+    bool Get(FS_Archive archive, const std::string &path, DirList &entries, int *sort);
+    bool Take(FS_Archive archive, const std::string &path, DirList &entries, int *sort);
+    void Put(FS_Archive archive, const std::string &path, int sort, DirList entries);
+    void Invalidate(FS_Archive archive, const std::string &path);
+    void InvalidateTree(FS_Archive archive, const std::string &path);
+    void Clear(void);
+    void GetStats(u32 *hits, u32 *misses);
+}
+
+#endif
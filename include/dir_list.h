@@ -0,0 +1,49 @@
+#ifndef _3D_SHELL_DIR_LIST_H
+#define _3D_SHELL_DIR_LIST_H
+
+#include <3ds.h>
+#include <string>
+#include <vector>
+
+typedef enum FileType {
+    FileTypeNone,
+    FileTypeArchive,
+    FileTypeImage,
+    FileTypeText,
+    FileTypeZip
+} FileType;
+
+// Compact directory listing. Names are packed back to back (NUL terminated) into a single pool and the
+// remaining fields live in parallel arrays, so an entry costs its name plus a few words instead of a full FS_DirectoryEntry.
+// Everything the file browser draws (UTF-8 name, display label, file type) is derived once when an entry is added.
+typedef struct DirList {
+    std::vector<char16_t> names;
+    std::vector<char> strings;
+    std::vector<u32> name_offsets;
+    std::vector<u32> utf8_offsets;
+    std::vector<u32> label_offsets;
+    std::vector<u32> attributes;
+    std::vector<u64> sizes;
+    std::vector<u8> types;
+
+    u32 Size(void) const { return name_offsets.size(); }
+    bool Empty(void) const { return name_offsets.empty(); }
+    const char16_t *GetName(u32 index) const { return &names[name_offsets[index]]; }
+    const char *GetUTF8Name(u32 index) const { return &strings[utf8_offsets[index]]; }
+    const char *GetLabel(u32 index) const { return &strings[label_offsets[index]]; }
+    bool IsDir(u32 index) const { return (attributes[index] & FS_ATTRIBUTE_DIRECTORY); }
+    u64 GetSize(u32 index) const { return sizes[index]; }
+    FileType GetType(u32 index) const { return static_cast<FileType>(types[index]); }
+
+    void Clear(void);
+    void Add(const char16_t *name, u32 attributes, u64 size);
+    void Add(const FS_DirectoryEntry &entry);
+    void Append(const DirList &list);
+    void Remove(u32 index);
+    void SetName(u32 index, const std::u16string &name);
+    int Find(const std::u16string &name) const;
+    void Gather(const std::vector<u32> &order);
+    std::size_t GetMemoryUsage(void) const;
+} DirList;
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef _3D_SHELL_DURABILITY_H
+#define _3D_SHELL_DURABILITY_H
+
+#include <3ds.h>
+
+typedef enum {
+    DurabilityChunk,   // every write is flushed as it's made
+    DurabilityClose,   // each file is flushed once, just before it's closed
+    DurabilityDeferred // no flush of its own, files are committed as they're closed and files kept open for a whole
+                       // operation (the log, a journal, a download) are flushed when it ends
+} DurabilityMode;
+
+// Writes are grouped by what they're for, each group has its own setting.
+typedef enum {
+    DurabilityCopy,     // copying, moving and extracting
+    DurabilityDownload, // update downloads and the CIA install
+    DurabilityLog,
+    DurabilityState     // settings, journals, the trash index and tuning data
+} DurabilityClass;
+
+namespace Durability {
+    DurabilityMode GetMode(DurabilityClass type);
+    const char *GetName(DurabilityMode mode);
+    const char *GetSummary(DurabilityMode mode);
+    u32 GetWriteFlags(DurabilityClass type);
+    Result Close(DurabilityClass type, Handle handle, bool job_end = false);
+}
+
+#endif
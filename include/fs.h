@@ -5,15 +5,16 @@
 #include <string>
 #include <vector>
 
+#include "conflict.h"
+#include "dir_list.h"
+
 extern FS_Archive archive, sdmc_archive, nand_archive;
 
-typedef enum FileType {
-    FileTypeNone,
-    FileTypeArchive,
-    FileTypeImage,
-    FileTypeText,
-    FileTypeZip
-} FileType;
+typedef enum DirListState {
+    DirListIdle,
+    DirListLoading,
+    DirListDone
+} DirListState;
 
 namespace FS {
     Result OpenArchive(FS_Archive *archive, FS_ArchiveID id);
@@ -24,14 +25,21 @@ namespace FS {
     u64 GetTotalStorage(FS_SystemMediaType mediatype);
     u64 GetUsedStorage(FS_SystemMediaType mediatype);
     FileType GetFileType(const std::string &filename);
-    Result GetDirList(const std::string &path, std::vector<FS_DirectoryEntry> &entries);
-    Result ChangeDirNext(const std::string &path, std::vector<FS_DirectoryEntry> &entries);
-    Result ChangeDirPrev(std::vector<FS_DirectoryEntry> &entries);
-    Result Delete(FS_DirectoryEntry *entry);
-    Result Rename(FS_DirectoryEntry *entry, const std::string &filename);
-    void Copy(FS_DirectoryEntry *entry, const std::string &path);
-    Result Paste(void);
-    Result Move(void);
+    Result GetDirList(const std::string &path, DirList &entries);
+    void SortDirList(DirList &entries, std::vector<u32> &order);
+    DirListState PollDirList(DirList &entries, std::vector<u32> &order);
+    void CancelDirList(void);
+    Result ChangeDir(const std::string &path, DirList &entries);
+    Result ChangeDirNext(const std::string &path, DirList &entries);
+    Result ChangeDirPrev(DirList &entries);
+    Result Rename(const DirList &entries, u32 index, const std::string &filename);
+    Result MakeDir(const std::string &name);
+    Result MakeFile(const std::string &name);
+    Result CopyTree(FS_Archive src_archive, const std::u16string &src, FS_Archive dest_archive, const std::u16string &dest, bool is_dir, 
+        ConflictPolicy policy);
+    Result MoveTree(FS_Archive src_archive, const std::u16string &src, FS_Archive dest_archive, const std::u16string &dest, bool is_dir, 
+        ConflictPolicy policy);
+    Result DeleteTree(FS_Archive archive, const std::u16string &path, bool is_dir);
 }
 
 #endif
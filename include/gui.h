@@ -5,6 +5,8 @@
 #include <citro2d.h>
 #include <vector>
 
+#include "dir_list.h"
+
 enum MENU_STATES {
     MENU_STATE_FILEBROWSER,
     MENU_STATE_OPTIONS,
@@ -14,15 +16,17 @@ enum MENU_STATES {
     MENU_STATE_IMAGEVIEWER,
     MENU_STATE_ARCHIVEEXTRACT,
     MENU_STATE_TEXTREADER,
-    MENU_STATE_UPDATE
+    MENU_STATE_UPDATE,
+    MENU_STATE_JOBS,
+    MENU_STATE_RESUME,
+    MENU_STATE_TRASH
 };
 
 typedef struct {
     MENU_STATES state = MENU_STATE_FILEBROWSER;
     int selected = 0;
-    std::vector<FS_DirectoryEntry> entries;
+    DirList entries;
     std::vector<bool> checked;
-    std::vector<bool> checked_copy;
     std::string checked_cwd;
     int checked_count = 0;
     u64 used_storage = 0;
@@ -33,7 +37,9 @@ typedef struct {
 namespace GUI {
     void ResetCheckbox(MenuItem *item);
     void RecalcStorageSize(MenuItem *item);
-    void ProgressBar(const std::string &title, std::string message, u64 offset, u64 size);
+    void UpdateDirList(MenuItem *item);
+    void SortDirList(MenuItem *item);
+    void ProgressBar(const std::string &title, std::string message, u64 offset, u64 size, const std::string &status);
     void DownloadProgressBar(void *args);
     Result Loop(void);
 
@@ -53,6 +59,14 @@ namespace GUI {
     void ControlDeleteOptions(MenuItem *item, u32 *kDown);
     void DisplayUpdateOptions(bool *connection_status, bool *available, const std::string &tag);
     void ControlUpdateOptions(MenuItem *item, u32 *kDown, bool *state, bool *connection_status, bool *available, const std::string &tag);
+    void DisplayJobs(MenuItem *item);
+    void ControlJobs(MenuItem *item, u32 *kDown);
+    bool WaitForJobs(void);
+    void CheckInterrupted(MenuItem *item);
+    void DisplayResume(MenuItem *item);
+    void ControlResume(MenuItem *item, u32 *kDown);
+    void DisplayTrash(MenuItem *item);
+    void ControlTrash(MenuItem *item, u32 *kDown);
 }
 
 #endif
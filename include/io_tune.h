@@ -0,0 +1,17 @@
+#ifndef _3D_SHELL_IO_TUNE_H
+#define _3D_SHELL_IO_TUNE_H
+
+#include <3ds.h>
+
+namespace IOTune {
+    // Largest chunk a transfer may be asked to use, buffers sized to this fit every candidate.
+    static const u32 max_chunk_size = 0x80000;
+    
+    int Load(void);
+    int Save(void);
+    u32 GetDirection(FS_Archive src, FS_Archive dest);
+    u32 GetChunkSize(u32 direction);
+    void Record(u32 direction, u32 chunk_size, u32 bytes, u64 ticks);
+}
+
+#endif
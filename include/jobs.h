@@ -0,0 +1,71 @@
+#ifndef _3D_SHELL_JOBS_H
+#define _3D_SHELL_JOBS_H
+
+#include <3ds.h>
+#include <string>
+#include <vector>
+
+#include "conflict.h"
+#include "progress.h"
+
+typedef enum JobType {
+    JobCopy,
+    JobMove,
+    JobDelete,
+    JobExtract,
+    JobTrash,
+    JobPurge
+} JobType;
+
+typedef enum JobState {
+    JobQueued,
+    JobRunning,
+    JobPaused,
+    JobDone,
+    JobFailed,
+    JobCancelled
+} JobState;
+
+// One queued operation on a set of entries in src_dir, copied or moved into dest_dir. An extraction has a single
+// entry, the archive file. A purge deletes items from the trash, named by their id. Directories end with a '/' like
+// cfg.cwd.
+typedef struct Job {
+    u32 id = 0;
+    JobType type = JobCopy;
+    JobState state = JobQueued;
+    FS_Archive src_archive = 0;
+    FS_Archive dest_archive = 0;
+    std::string src_dir;
+    std::string dest_dir;
+    std::vector<std::u16string> names;
+    std::vector<u8> dirs;
+    std::vector<std::u16string> dest_names; // set once the job starts where an item is kept alongside under a new name
+    ConflictPolicy conflict = ConflictOverwrite;
+    Result result = 0;
+    ProgressInfo info; // live while running, the final counts once finished
+    bool held = false; // paused before it started
+    bool handled = false; // finished and the listing cache brought up to date
+    bool resume = false; // carries on from the journal of an interrupted run
+    bool undoing = false; // moves items back, so isn't recorded for undo itself
+
+    void AddItem(const char16_t *name, bool dir);
+    const std::u16string &GetDestName(u32 index) const { return index < dest_names.size()? dest_names[index] : names[index]; }
+    bool IsFinished(void) const { return (state == JobDone) || (state == JobFailed) || (state == JobCancelled); }
+} Job;
+
+namespace Jobs {
+    void Init(void);
+    void Exit(void);
+    u32 Add(const Job &job);
+    void Pause(u32 id);
+    void Resume(u32 id);
+    void Cancel(u32 id);
+    void ClearFinished(void);
+    void GetJobs(std::vector<Job> &jobs);
+    u32 GetActiveCount(void);
+    bool IsBusy(FS_Archive archive, const std::string &path);
+    bool Update(FS_Archive archive, const std::string &cwd);
+    std::string GetTitle(const Job &job);
+}
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef _3D_SHELL_JOURNAL_H
+#define _3D_SHELL_JOURNAL_H
+
+#include <3ds.h>
+
+#include "jobs.h"
+#include "tree_walk.h"
+
+namespace Journal {
+    bool Load(Job &job);
+    void Discard(void);
+    void Begin(const Job &job);
+    void SetItem(u32 item);
+    bool GetManifest(TreeManifest &manifest);
+    void SetManifest(const TreeManifest &manifest);
+    bool IsActive(void);
+    bool IsComplete(u32 index);
+    bool IsSkipped(u32 index);
+    u64 GetOffset(u32 index);
+    void Complete(u32 index);
+    void Skip(u32 index);
+    void SetFile(s32 index);
+    void Checkpoint(u64 offset);
+    void Sync(void);
+    void End(bool keep);
+}
+
+#endif
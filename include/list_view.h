@@ -0,0 +1,30 @@
+#ifndef _3D_SHELL_LIST_VIEW_H
+#define _3D_SHELL_LIST_VIEW_H
+
+#include <3ds.h>
+
+// A vertical list of fixed height rows. Only the rows on screen (plus one row of overscan) are ever visited,
+// so the cost of drawing or hit testing a list doesn't depend on how many items it holds.
+typedef struct {
+    float x = 0.f;
+    float y = 0.f;
+    float width = 0.f;
+    float row_height = 0.f;
+    int visible = 0; // Rows that fit in the view
+    int start = 0; // First row on screen
+} ListView;
+
+namespace GUI {
+    void ScrollListView(ListView *view, int selected, int count);
+    int GetTouchedRow(const ListView *view, int count);
+
+    // Calls draw_row(index, y) for every row that is (at least partly) on screen.
+    template<typename Func> void DrawListView(const ListView *view, int count, Func draw_row) {
+        int end = view->start + view->visible + 1;
+
+        for (int i = view->start; (i < count) && (i < end); i++)
+            draw_row(i, view->y + ((i - view->start) * view->row_height));
+    }
+}
+
+#endif
@@ -6,7 +6,9 @@
 namespace Log {
     Result Open(void);
     Result Close(void);
+    void Flush(void);
     void Error(const char *data, ...);
+    void Debug(const char *data, ...);
 }
 
 #endif
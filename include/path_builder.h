@@ -0,0 +1,28 @@
+#ifndef _3D_SHELL_PATH_BUILDER_H
+#define _3D_SHELL_PATH_BUILDER_H
+
+#include <3ds.h>
+#include <string>
+
+// A UTF-16 path edited in place. Append() adds a component and returns the previous length, which Truncate()
+// goes back to, so a whole tree walk reuses one buffer and only allocates when a path is longer than any before it.
+typedef struct PathBuilder {
+    std::u16string path;
+
+    PathBuilder(void);
+    PathBuilder(const std::string &path);
+    PathBuilder(const std::u16string &path);
+
+    u32 Length(void) const { return path.length(); }
+    const char16_t *GetName(void) const;
+    FS_Path GetPath(void) const { return fsMakePath(PATH_UTF16, path.c_str()); }
+    
+    void Set(const std::string &path);
+    u32 Append(const char16_t *name);
+    u32 Append(const std::u16string &name);
+    u32 Append(const std::string &name);
+    void Truncate(u32 length) { path.resize(length); }
+    std::string ToUTF8(void) const;
+} PathBuilder;
+
+#endif
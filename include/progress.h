@@ -0,0 +1,50 @@
+#ifndef _3D_SHELL_PROGRESS_H
+#define _3D_SHELL_PROGRESS_H
+
+#include <3ds.h>
+#include <string>
+
+#include "durability.h"
+
+typedef struct {
+    std::string title;
+    std::string name;
+    u64 offset = 0; // current file
+    u64 size = 0;
+    u64 bytes = 0; // whole operation
+    u64 total_bytes = 0;
+    u32 files = 0;
+    u32 total_files = 0;
+    u32 failed = 0;
+    u32 skipped = 0; // left as the destination had them
+    u64 rate = 0; // bytes per second, smoothed
+    u32 file_rate = 0; // files per second, smoothed
+    u64 elapsed = 0; // ms
+    u32 verified = 0; // files checked after copying
+    u32 mismatches = 0;
+    u64 verify_time = 0; // ms spent re-reading and retrying
+    int durability = -1; // DurabilityMode the data was written with, -1 if the operation didn't say
+    bool paused = false;
+    bool cancelled = false;
+} ProgressInfo;
+
+namespace Progress {
+    void Init(void);
+    void Start(const std::string &title, bool modal);
+    void AddTotal(u64 bytes, u32 files);
+    void SetItem(const std::string &name, u64 size);
+    void Add(u64 bytes);
+    void ItemDone(Result ret);
+    void AddSkipped(u32 files, u64 bytes);
+    void AddVerify(u64 ms, u32 mismatches);
+    void SetDurability(DurabilityMode mode);
+    bool IsCancelled(void);
+    void SetPaused(bool paused);
+    void Cancel(void);
+    void GetInfo(ProgressInfo *info);
+    void GetStatus(const ProgressInfo &info, char *status, std::size_t length);
+    void GetSummary(const ProgressInfo &info, char *summary, std::size_t length);
+    void End(void);
+}
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef _3D_SHELL_TRASH_H
+#define _3D_SHELL_TRASH_H
+
+#include <3ds.h>
+#include <string>
+#include <vector>
+
+// One deleted file or folder, stored in the trash under its id.
+typedef struct {
+    u32 id = 0;
+    std::string path; // where it was deleted from
+    bool dir = false;
+    u64 size = 0; // every file inside, for a folder
+    u32 files = 0;
+    u64 time = 0; // when it was deleted
+} TrashItem;
+
+namespace Trash {
+    void Init(void);
+    const std::string &GetDir(void);
+    std::string GetPath(u32 id);
+    bool Contains(const std::string &path);
+    Result Add(FS_Archive archive, const std::string &path, bool is_dir, u32 *id);
+    void Remove(FS_Archive archive, u32 id);
+    Result Restore(FS_Archive archive, const TrashItem &item);
+    void GetItems(FS_Archive archive, std::vector<TrashItem> &items);
+    bool GetPurgeList(FS_Archive archive, std::vector<TrashItem> &items);
+}
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef _3D_SHELL_TREE_WALK_H
+#define _3D_SHELL_TREE_WALK_H
+
+#include <3ds.h>
+#include <string>
+#include <vector>
+
+#include "path_builder.h"
+
+// Every entry below a root, gathered before anything is done to them. Paths are relative to the root and packed into one
+// pool like DirList, a directory always comes before its contents (so walking it backwards visits contents first).
+// A single file is one entry with an empty path.
+typedef struct TreeManifest {
+    std::vector<char16_t> paths;
+    std::vector<u32> path_offsets;
+    std::vector<u64> sizes;
+    std::vector<u8> dirs;
+    u64 total_bytes = 0;
+    u32 num_files = 0;
+    u32 num_dirs = 0;
+    u32 errors = 0; // directories that couldn't be read, their contents are missing
+    Result result = 0; // first of those errors
+
+    u32 Size(void) const { return path_offsets.size(); }
+    const char16_t *GetPath(u32 index) const { return &paths[path_offsets[index]]; }
+    bool IsDir(u32 index) const { return dirs[index]; }
+    u64 GetSize(u32 index) const { return sizes[index]; }
+
+    void Clear(void);
+    void Add(const std::u16string &path, bool dir, u64 size);
+} TreeManifest;
+
+namespace TreeWalk {
+    Result Build(FS_Archive archive, PathBuilder &root, bool is_dir, TreeManifest &manifest);
+}
+
+#endif
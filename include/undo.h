@@ -0,0 +1,37 @@
+#ifndef _3D_SHELL_UNDO_H
+#define _3D_SHELL_UNDO_H
+
+#include <3ds.h>
+#include <string>
+#include <vector>
+
+typedef enum UndoType {
+    UndoRename,
+    UndoMove,
+    UndoCreate,
+    UndoTrash
+} UndoType;
+
+// What one operation did to a single entry, enough to reverse it. src is where it was and dest where it ended up, a new
+// entry only has src.
+typedef struct {
+    UndoType type = UndoRename;
+    FS_Archive src_archive = 0;
+    FS_Archive dest_archive = 0;
+    bool dir = false;
+    u32 id = 0; // trash id
+    std::string src;
+    std::string dest;
+} UndoEntry;
+
+namespace Undo {
+    void Init(void);
+    void Exit(void);
+    void Record(const UndoEntry &entry);
+    void Record(const std::vector<UndoEntry> &entries);
+    void Flush(void);
+    const char *GetLabel(void);
+    Result Revert(void);
+}
+
+#endif
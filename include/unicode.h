@@ -0,0 +1,15 @@
+#ifndef _3D_SHELL_UNICODE_H
+#define _3D_SHELL_UNICODE_H
+
+#include <3ds.h>
+#include <string>
+
+namespace Unicode {
+    u32 UTF8ToUTF16(char16_t *dest, u32 dest_size, const char *src, u32 src_length);
+    u32 UTF16ToUTF8(char *dest, u32 dest_size, const char16_t *src, u32 src_length);
+    std::u16string ToUTF16(const std::string &src);
+    std::string ToUTF8(const char16_t *src, u32 src_length);
+    std::string ToUTF8(const std::u16string &src);
+}
+
+#endif
@@ -1,19 +1,23 @@
 #include <archive.h>
 #include <archive_entry.h>
-#include <cstring>
 #include <filesystem>
 #include <string>
 
-#include "config.h"
+#include "archive_helper.h"
+#include "buffer_pool.h"
+#include "conflict.h"
+#include "durability.h"
 #include "fs.h"
-#include "gui.h"
+#include "io_tune.h"
 #include "log.h"
-#include "utils.h"
+#include "progress.h"
+#include "unicode.h"
 
 namespace ArchiveHelper {
-    u64 CountFiles(const std::string &path) {
+    // Sums the uncompressed size of every entry whose size the archive records, files counts the entries with data.
+    static u64 GetExtractedSize(const std::string &path, u32 *files) {
         int ret = 0;
-        u64 count = 0;
+        u64 size = 0;
 
         struct archive *arch = archive_read_new();
         archive_read_support_format_all(arch);
@@ -21,7 +25,7 @@ namespace ArchiveHelper {
         if ((ret = archive_read_open_filename(arch, path.c_str(), 0x3000)) != ARCHIVE_OK) {
             archive_read_close(arch);
             archive_read_free(arch);
-            return ret;
+            return 0;
         }
 
         struct archive_entry *entry;
@@ -29,15 +33,20 @@ namespace ArchiveHelper {
             if (ret == ARCHIVE_EOF)
                 break;
 
-            count++;
+            if ((archive_entry_size_is_set(entry)) && (archive_entry_size(entry) > 0)) {
+                size += archive_entry_size(entry);
+                *files += 1;
+            }
         }
         
         archive_read_close(arch);
         archive_read_free(arch);
-        return count;
+        return size;
     }
 
-    int Extract(const std::string &path) {
+    // Extracts path into a folder named after it inside dest_dir (which ends with a '/'). If that folder is already there,
+    // what it has is listed once up front and each file in the archive settled against that by policy.
+    int Extract(FS_Archive dest_archive, const std::string &path, const std::string &dest_dir, ConflictPolicy policy) {
         int ret = 0;
 
         int flags = ARCHIVE_EXTRACT_TIME;
@@ -60,15 +69,30 @@ namespace ArchiveHelper {
             return ret;
         }
 
-        u64 index = 0, count = ArchiveHelper::CountFiles(path);
-        std::string filename = std::filesystem::path(path).filename();
-        std::string dest = cfg.cwd;
-        dest.append(std::filesystem::path(path).stem());
-        FSUSER_CreateDirectory(archive, fsMakePath(PATH_ASCII, dest.c_str()), 0);
+        u32 files = 0;
+        u64 size = ArchiveHelper::GetExtractedSize(path, &files);
+        Progress::AddTotal(size, files);
+        Progress::SetItem(std::filesystem::path(path).filename(), 0);
+        // Only reads the chunk size tuned for copies, extraction time is bound by decompression so isn't recorded.
+        u32 direction = IOTune::GetDirection(sdmc_archive, dest_archive);
+        std::string dest = dest_dir;
+        
+        if (policy == ConflictRename)
+            dest.append(Unicode::ToUTF8(Conflict::GetFreeName(dest_archive, dest_dir, Unicode::ToUTF16(std::filesystem::path(path).stem()), true)));
+        else
+            dest.append(std::filesystem::path(path).stem());
+            
+        ConflictScan scan;
+        if ((policy == ConflictSkip) || (policy == ConflictUpdate)) {
+            PathBuilder dest_root(dest);
+            Conflict::Scan(dest_archive, dest_root, scan);
+        }
+        
+        FSUSER_CreateDirectory(dest_archive, fsMakePath(PATH_ASCII, dest.c_str()), 0);
 
         struct archive_entry *entry = nullptr;
         while((ret = archive_read_next_header(arch, &entry)) == ARCHIVE_OK) {
-            if (Utils::IsCancelButtonPressed()) {
+            if (Progress::IsCancelled()) {
                 archive_read_close(arch);
                 archive_read_free(arch);
                 archive_write_close(ext);
@@ -85,18 +109,39 @@ namespace ArchiveHelper {
             std::string dest_path = dest + "/";
             dest_path.append(entry_name);
             
-            archive_entry_update_pathname_utf8(entry, dest_path.c_str());
-            
             s64 entry_size = archive_entry_size(entry);
+            
+            if ((entry_size > 0) && (!scan.files.empty())) {
+                std::string rel_path = entry_name;
+                if (!rel_path.compare(0, 2, "./"))
+                    rel_path.erase(0, 2);
+                    
+                PathBuilder dest_file(dest_path);
+                u64 entry_time = archive_entry_mtime_is_set(entry)? archive_entry_mtime(entry) : 0;
+                
+                if (Conflict::Keep(policy, scan, Unicode::ToUTF16(rel_path), entry_size, entry_time, dest_archive, dest_file)) {
+                    Progress::AddSkipped(1, entry_size);
+                    archive_read_data_skip(arch);
+                    continue;
+                }
+            }
+            
+            archive_entry_update_pathname_utf8(entry, dest_path.c_str());
             ret = archive_write_header(ext, entry);
-            if (ret < ARCHIVE_OK)
+            if (ret < ARCHIVE_OK) {
                 Log::Error("archive_write_header(%s) failed: %s\n", dest_path.c_str(), archive_error_string(arch));
+                
+                if (entry_size > 0)
+                    Progress::ItemDone(-1);
+            }
             else if (entry_size > 0) {
+                Progress::SetItem(entry_name, entry_size);
                 Handle dest_handle;
-                FSUSER_CreateFile(archive, fsMakePath(PATH_ASCII, dest_path.c_str()), 0, entry_size);
+                FSUSER_CreateFile(dest_archive, fsMakePath(PATH_ASCII, dest_path.c_str()), 0, entry_size);
                 
-                if (R_FAILED(ret = FSUSER_OpenFile(&dest_handle, archive, fsMakePath(PATH_ASCII, dest_path.c_str()), FS_OPEN_WRITE, 0))) {
+                if (R_FAILED(ret = FSUSER_OpenFile(&dest_handle, dest_archive, fsMakePath(PATH_ASCII, dest_path.c_str()), FS_OPEN_WRITE, 0))) {
                     Log::Error("FSUSER_OpenFile(%s) failed: 0x%x\n", dest_path.c_str(), ret);
+                    Progress::ItemDone(ret);
                     archive_read_close(arch);
                     archive_read_free(arch);
                     archive_write_close(ext);
@@ -105,45 +150,53 @@ namespace ArchiveHelper {
                 }
                 
                 u32 bytes_written = 0;
-                const u64 buf_size = 0x10000;
                 u64 offset = 0;
-                u8 *buf = new u8[buf_size];
+                u8 *buf = BufferPool::Checkout();
+                
+                if (!buf) {
+                    Progress::ItemDone(-1);
+                    archive_read_close(arch);
+                    archive_read_free(arch);
+                    archive_write_close(ext);
+                    archive_write_free(ext);
+                    FSFILE_Close(dest_handle);
+                    return -1;
+                }
                 
                 do {
-                    if (Utils::IsCancelButtonPressed()) {
+                    if (Progress::IsCancelled()) {
                         FSFILE_SetSize(dest_handle, offset);
                         archive_read_close(arch);
                         archive_read_free(arch);
                         archive_write_close(ext);
                         archive_write_free(ext);
-                        delete[] buf;
+                        BufferPool::Return(buf);
                         FSFILE_Close(dest_handle);
                         return 0;
                     }
 
-                    std::memset(buf, 0, buf_size);
-                    u32 bytes_read = archive_read_data(arch, buf, buf_size);
+                    u32 bytes_read = archive_read_data(arch, buf, IOTune::GetChunkSize(direction));
                     
-                    if (R_FAILED(ret = FSFILE_Write(dest_handle, &bytes_written, offset, buf, bytes_read, FS_WRITE_FLUSH))) {
+                    if (R_FAILED(ret = FSFILE_Write(dest_handle, &bytes_written, offset, buf, bytes_read, Durability::GetWriteFlags(DurabilityCopy)))) {
                         Log::Error("FSFILE_Write(%s) failed: 0x%x\n", dest_path.c_str(), ret);
+                        Progress::ItemDone(ret);
                         archive_read_close(arch);
                         archive_read_free(arch);
                         archive_write_close(ext);
                         archive_write_free(ext);
-                        delete[] buf;
+                        BufferPool::Return(buf);
                         FSFILE_Close(dest_handle);
                         return ret;
                     }
                     
                     offset += bytes_read;
+                    Progress::Add(bytes_read);
                 } while(offset < static_cast<u64>(entry_size));
 
-                delete[] buf;
-                FSFILE_Close(dest_handle);
+                BufferPool::Return(buf);
+                Durability::Close(DurabilityCopy, dest_handle);
+                Progress::ItemDone(0);
             }
-
-            GUI::ProgressBar("Extracting", filename, index, count);
-            index++;
         }
         
         archive_read_close(arch);
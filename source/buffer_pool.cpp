@@ -0,0 +1,95 @@
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+#include "buffer_pool.h"
+#include "log.h"
+
+// Bulk I/O (copies, extraction, installs, reading images) borrows its buffers from here instead of allocating them per
+// file. Buffers are allocated on first use, page aligned, and kept once returned, so a copy of thousands of files reuses
+// the same few blocks of heap rather than churning it. Nothing is cleared between uses, a buffer only ever holds what
+// was last read into it. A checkout the pool can't serve (all in use, or bigger than a buffer) gets a one-off
+// allocation that is freed again on return, so callers never wait.
+namespace BufferPool {
+    static const u32 buffer_alignment = 0x1000;
+    static const u32 max_buffers = 12;
+    
+    static std::vector<u8 *> buffers; // every pooled buffer
+    static std::vector<u8 *> free_buffers;
+    static BufferPoolStats stats;
+    static LightLock lock;
+    
+    void Init(void) {
+        LightLock_Init(&lock);
+    }
+    
+    void Exit(void) {
+        Log::Debug("BufferPool: %lu buffers of %lu bytes, %lu at most in use, %lu checkouts, %lu overflows\n", stats.allocated, buffer_size, 
+            stats.high_water, stats.checkouts, stats.overflows);
+            
+        for (u8 *buf : buffers)
+            std::free(buf);
+            
+        buffers.clear();
+        free_buffers.clear();
+        stats = BufferPoolStats();
+    }
+    
+    u8 *Checkout(u32 size) {
+        u8 *buf = nullptr;
+        LightLock_Lock(&lock);
+        stats.checkouts++;
+        
+        if (size <= buffer_size) {
+            if (!free_buffers.empty()) {
+                buf = free_buffers.back();
+                free_buffers.pop_back();
+            }
+            else if ((buffers.size() < max_buffers) && ((buf = static_cast<u8 *>(std::aligned_alloc(buffer_alignment, buffer_size))))) {
+                buffers.push_back(buf);
+                stats.allocated++;
+            }
+        }
+        
+        if (buf) {
+            stats.in_use++;
+            stats.high_water = std::max(stats.high_water, stats.in_use);
+            LightLock_Unlock(&lock);
+            return buf;
+        }
+        
+        stats.overflows++;
+        LightLock_Unlock(&lock);
+        
+        // aligned_alloc wants a multiple of the alignment.
+        u32 alloc_size = (std::max(size, 1U) + buffer_alignment - 1) & ~(buffer_alignment - 1);
+        if (!(buf = static_cast<u8 *>(std::aligned_alloc(buffer_alignment, alloc_size))))
+            Log::Error("BufferPool::Checkout(%lu) failed\n", size);
+            
+        return buf;
+    }
+    
+    void Return(u8 *buf) {
+        if (!buf)
+            return;
+            
+        LightLock_Lock(&lock);
+        bool pooled = std::find(buffers.begin(), buffers.end(), buf) != buffers.end();
+        
+        if (pooled) {
+            free_buffers.push_back(buf);
+            stats.in_use--;
+        }
+        
+        LightLock_Unlock(&lock);
+        
+        if (!pooled)
+            std::free(buf);
+    }
+    
+    void GetStats(BufferPoolStats *stats) {
+        LightLock_Lock(&lock);
+        *stats = BufferPool::stats;
+        LightLock_Unlock(&lock);
+    }
+}
@@ -1,10 +1,12 @@
-#include <cstring>
 #include <string>
 
+#include "buffer_pool.h"
 #include "cia.h"
+#include "durability.h"
 #include "fs.h"
-#include "gui.h"
+#include "io_tune.h"
 #include "log.h"
+#include "progress.h"
 
 namespace CIA {
     static const std::string path = "/3ds/3DShell/3DShell_UPDATE.cia";
@@ -54,40 +56,62 @@ namespace CIA {
             return ret;
         }
         
-        u32 buffer_size = 0x10000;
-        u8 *buffer = new u8[buffer_size];
+        // The title is installed to the SD card, so this is tuned as an SD to SD transfer.
+        u32 direction = IOTune::GetDirection(sdmc_archive, sdmc_archive);
+        u8 *buffer = BufferPool::Checkout();
+        if (!buffer) {
+            AM_CancelCIAInstall(dst_handle);
+            FSFILE_Close(src_handle);
+            return -1;
+        }
+        
+        // AM commits the title itself once the install is finished, so only the per chunk mode changes anything here.
+        Progress::Start("Installing", true);
+        Progress::SetDurability(Durability::GetMode(DurabilityDownload));
+        Progress::AddTotal(size, 1);
+        Progress::SetItem("3DShell_UPDATE.cia", size);
         
         do {
-            std::memset(buffer, 0, buffer_size);
+            u32 chunk_size = IOTune::GetChunkSize(direction);
+            u64 start_tick = svcGetSystemTick();
             
-            if (R_FAILED(ret = FSFILE_Read(src_handle, &bytes_read, offset, buffer, buffer_size))) {
-                delete[] buffer;
+            if (R_FAILED(ret = FSFILE_Read(src_handle, &bytes_read, offset, buffer, chunk_size))) {
+                Progress::ItemDone(ret);
+                Progress::End();
+                BufferPool::Return(buffer);
                 FSFILE_Close(src_handle);
                 FSFILE_Close(dst_handle);
                 Log::Error("FSFILE_Read failed: 0x%x\n", ret);
                 return ret;
             }
             
-            if (R_FAILED(ret = FSFILE_Write(dst_handle, &bytes_written, offset, buffer, bytes_read, FS_WRITE_FLUSH))) {
-                delete[] buffer;
+            if (R_FAILED(ret = FSFILE_Write(dst_handle, &bytes_written, offset, buffer, bytes_read, Durability::GetWriteFlags(DurabilityDownload)))) {
+                Progress::ItemDone(ret);
+                Progress::End();
+                BufferPool::Return(buffer);
                 FSFILE_Close(src_handle);
                 FSFILE_Close(dst_handle);
                 Log::Error("FSFILE_Read failed: 0x%x\n", ret);
                 return ret;
             }
             
+            IOTune::Record(direction, chunk_size, bytes_read, svcGetSystemTick() - start_tick);
             offset += bytes_read;
-            GUI::ProgressBar("Installing", "3DShell_UPDATE.cia", offset, size);
+            Progress::Add(bytes_read);
         } while(offset < size);
         
+        Progress::ItemDone(0);
+        Progress::End();
+        IOTune::Save();
+        
         if (bytes_read != bytes_written) {
             AM_CancelCIAInstall(dst_handle);
-            delete[] buffer;
+            BufferPool::Return(buffer);
             Log::Error(".CIA bytes read and written mismatch: 0x%x\n", ret);
             return ret;
         }
         
-        delete[] buffer;
+        BufferPool::Return(buffer);
         
         if (R_FAILED(ret = AM_FinishCiaInstall(dst_handle))) {
             Log::Error("AM_FinishCiaInstall failed: 0x%x\n", ret);
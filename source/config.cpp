@@ -3,6 +3,7 @@
 #include <string>
 
 #include "config.h"
+#include "durability.h"
 #include "fs.h"
 #include "log.h"
 
@@ -11,14 +12,16 @@
 config_t cfg;
 
 namespace Config {
-    static const char *config_file = "{\n\t\"config_ver\": %d,\n\t\"sort\": %d,\n\t\"dev_options\": %d,\n\t\"dark_theme\": %d,\n\t\"last_dir\": \"%s\"\n}";
+    static const char *config_file = "{\n\t\"config_ver\": %d,\n\t\"sort\": %d,\n\t\"dev_options\": %d,\n\t\"dark_theme\": %d,\n\t\"verify_copy\": %d,\n\t\"use_trash\": %d,\n\t\"conflict_policy\": %d,\n\t\"copy_durability\": %d,\n\t\"download_durability\": %d,\n\t\"log_durability\": %d,\n\t\"state_durability\": %d,\n\t\"last_dir\": \"%s\"\n}";
     static int config_version_holder = 0;
     static std::string config_path = "/3ds/3DShell/config.json";
     
     int Save(config_t config) {
         Result ret = 0;
         char *buf = new char[1024];
-        u32 length = std::snprintf(buf, 1024, config_file, CONFIG_VERSION, config.sort, config.dev_options, config.dark_theme, config.cwd.c_str());
+        u32 length = std::snprintf(buf, 1024, config_file, CONFIG_VERSION, config.sort, config.dev_options, config.dark_theme, config.verify_copy, 
+            config.use_trash, config.conflict_policy, config.copy_durability, config.download_durability, config.log_durability, config.state_durability, 
+            config.cwd.c_str());
         
         // Delete and re-create the file, we don't care about the return value here.
         FSUSER_DeleteFile(sdmc_archive, fsMakePath(PATH_ASCII, config_path.c_str()));
@@ -32,7 +35,7 @@ namespace Config {
         }
         
         u32 bytes_written = 0;
-        if (R_FAILED(ret = FSFILE_Write(file, &bytes_written, 0, buf, length, FS_WRITE_FLUSH))) {
+        if (R_FAILED(ret = FSFILE_Write(file, &bytes_written, 0, buf, length, Durability::GetWriteFlags(DurabilityState)))) {
             Log::Error("FSFILE_Write(/3ds/3DShell/config.json) failed: 0x%x\n", ret);
             FSFILE_Close(file);
             delete[] buf;
@@ -45,7 +48,7 @@ namespace Config {
             return ret;
         }
         
-        FSFILE_Close(file);
+        Durability::Close(DurabilityState, file);
         delete[] buf;
         return 0;
     }
@@ -54,6 +57,13 @@ namespace Config {
         config->sort = 0;
         config->dev_options = false;
         config->dark_theme = false;
+        config->verify_copy = false;
+        config->use_trash = false;
+        config->conflict_policy = 0;
+        config->copy_durability = DurabilityDeferred;
+        config->download_durability = DurabilityClose;
+        config->log_durability = DurabilityDeferred;
+        config->state_durability = DurabilityChunk;
         config->cwd = "/";
     }
     
@@ -117,6 +127,32 @@ namespace Config {
         json_t *dark_theme = json_object_get(root, "dark_theme");
         cfg.dark_theme = json_integer_value(dark_theme);
         
+        json_t *verify_copy = json_object_get(root, "verify_copy");
+        cfg.verify_copy = json_integer_value(verify_copy);
+        
+        json_t *use_trash = json_object_get(root, "use_trash");
+        cfg.use_trash = json_integer_value(use_trash);
+        
+        json_t *conflict_policy = json_object_get(root, "conflict_policy");
+        cfg.conflict_policy = json_integer_value(conflict_policy);
+        
+        // These came later, a config without them keeps the defaults.
+        json_t *copy_durability = json_object_get(root, "copy_durability");
+        if (json_is_integer(copy_durability))
+            cfg.copy_durability = json_integer_value(copy_durability);
+            
+        json_t *download_durability = json_object_get(root, "download_durability");
+        if (json_is_integer(download_durability))
+            cfg.download_durability = json_integer_value(download_durability);
+            
+        json_t *log_durability = json_object_get(root, "log_durability");
+        if (json_is_integer(log_durability))
+            cfg.log_durability = json_integer_value(log_durability);
+            
+        json_t *state_durability = json_object_get(root, "state_durability");
+        if (json_is_integer(state_durability))
+            cfg.state_durability = json_integer_value(state_durability);
+            
         json_t *last_dir = json_object_get(root, "last_dir");
         cfg.cwd = json_string_value(last_dir);
 
@@ -0,0 +1,153 @@
+#include "conflict.h"
+#include "fs.h"
+#include "log.h"
+#include "unicode.h"
+
+// Conflicts are settled before anything is written. The destination is walked once and every source file looked up in
+// that listing, so a tree that is mostly there already costs one directory walk rather than a query per file. Only
+// the files that need writing are then copied, a sync of a large tree copies just what is missing or changed.
+namespace Conflict {
+    static const u64 epoch_offset = 946684800; // 2000-01-01, where the archive timestamps start, as a UNIX time
+    static const u32 max_renames = 999;
+    
+    const char *GetName(ConflictPolicy policy) {
+        switch (policy) {
+            case ConflictOverwrite:
+                return "Overwrite";
+            case ConflictSkip:
+                return "Skip";
+            case ConflictUpdate:
+                return "If newer or larger";
+            case ConflictRename:
+                return "Keep both";
+        }
+        
+        return "";
+    }
+    
+    // As a UNIX time, or 0 where the archive doesn't keep timestamps (only the SD does).
+    u64 GetModifiedTime(FS_Archive archive, const PathBuilder &path) {
+        if (archive != sdmc_archive)
+            return 0;
+            
+        u64 mtime = 0;
+        if (R_FAILED(FSUSER_ControlArchive(archive, ARCHIVE_ACTION_GET_TIMESTAMP, const_cast<char16_t *>(path.path.c_str()), 
+            (path.Length() + 1) * sizeof(char16_t), &mtime, sizeof(mtime))))
+            return 0;
+            
+        return (mtime / 1000) + epoch_offset;
+    }
+    
+    // name itself if dir has nothing by that name, otherwise the first of "name (1)", "name (2)"... that's free. A file
+    // keeps its extension.
+    std::u16string GetFreeName(FS_Archive archive, const std::string &dir, const std::u16string &name, bool is_dir) {
+        std::string utf8_name = Unicode::ToUTF8(name);
+        
+        if ((!FS::FileExists(archive, dir + utf8_name)) && (!FS::DirExists(archive, dir + utf8_name)))
+            return name;
+            
+        std::size_t dot = is_dir? std::string::npos : utf8_name.find_last_of('.');
+        if (dot == 0)
+            dot = std::string::npos;
+            
+        std::string stem = utf8_name.substr(0, dot), ext = dot != std::string::npos? utf8_name.substr(dot) : std::string();
+        
+        for (u32 i = 1; i <= max_renames; i++) {
+            std::string candidate = stem + " (" + std::to_string(i) + ")" + ext;
+            
+            if ((!FS::FileExists(archive, dir + candidate)) && (!FS::DirExists(archive, dir + candidate)))
+                return Unicode::ToUTF16(candidate);
+        }
+        
+        Log::Error("GetFreeName(%s%s): no free name\n", dir.c_str(), utf8_name.c_str());
+        return name;
+    }
+    
+    Result Scan(FS_Archive archive, PathBuilder &root, ConflictScan &scan) {
+        Result ret = 0;
+        std::string path = root.ToUTF8();
+        bool is_dir = FS::DirExists(archive, path);
+        
+        scan.files.clear();
+        scan.exists = is_dir || FS::FileExists(archive, path);
+        
+        if (!scan.exists)
+            return 0;
+            
+        TreeManifest manifest;
+        if (R_FAILED(ret = TreeWalk::Build(archive, root, is_dir, manifest)))
+            return ret;
+            
+        for (u32 i = 0; i < manifest.Size(); i++) {
+            if (!manifest.IsDir(i))
+                scan.files.emplace(manifest.GetPath(i), manifest.GetSize(i));
+        }
+        
+        return 0;
+    }
+    
+    // Whether the file at rel_path should be left as the destination has it. dest_path is the file on the destination,
+    // its timestamp is only read when the sizes don't settle it. src_time is 0 if unknown.
+    bool Keep(ConflictPolicy policy, const ConflictScan &scan, const std::u16string &rel_path, u64 size, u64 src_time, FS_Archive dest_archive, 
+        const PathBuilder &dest_path) {
+        auto it = scan.files.find(rel_path);
+        if (it == scan.files.end())
+            return false;
+            
+        switch (policy) {
+            case ConflictSkip:
+                return true;
+                
+            case ConflictUpdate: {
+                if (size > it->second)
+                    return false;
+                    
+                u64 dest_time = src_time != 0? Conflict::GetModifiedTime(dest_archive, dest_path) : 0;
+                
+                // Without timestamps on both sides the source can't be shown to be newer, and it isn't larger.
+                if ((src_time == 0) || (dest_time == 0))
+                    return true;
+                    
+                return src_time <= dest_time;
+            }
+            
+            default:
+                return false;
+        }
+    }
+    
+    // Marks the manifest's files that the destination already has and should keep. Overwriting (and a renamed item,
+    // which has a root of its own) needs no scan at all.
+    Result Plan(FS_Archive src_archive, PathBuilder &src_path, FS_Archive dest_archive, PathBuilder &dest_path, const TreeManifest &manifest, 
+        ConflictPolicy policy, std::vector<u8> &skip) {
+        Result ret = 0;
+        skip.assign(manifest.Size(), 0);
+        
+        if ((policy != ConflictSkip) && (policy != ConflictUpdate))
+            return 0;
+            
+        ConflictScan scan;
+        if ((R_FAILED(ret = Conflict::Scan(dest_archive, dest_path, scan))) || (!scan.exists))
+            return ret;
+            
+        for (u32 i = 0; i < manifest.Size(); i++) {
+            if (manifest.IsDir(i))
+                continue;
+                
+            const char16_t *rel_path = manifest.GetPath(i);
+            u32 src_length = rel_path[0] != u'\0'? src_path.Append(rel_path) : src_path.Length();
+            u32 dest_length = rel_path[0] != u'\0'? dest_path.Append(rel_path) : dest_path.Length();
+            
+            // The source timestamp is only worth reading for a file the destination has and isn't smaller than.
+            auto it = scan.files.find(rel_path);
+            u64 src_time = ((policy == ConflictUpdate) && (it != scan.files.end()) && (manifest.GetSize(i) <= it->second))? 
+                Conflict::GetModifiedTime(src_archive, src_path) : 0;
+                
+            skip[i] = Conflict::Keep(policy, scan, rel_path, manifest.GetSize(i), src_time, dest_archive, dest_path);
+            src_path.Truncate(src_length);
+            dest_path.Truncate(dest_length);
+        }
+        
+        return 0;
+    }
+}
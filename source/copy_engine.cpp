@@ -0,0 +1,313 @@
+#include <zlib.h>
+
+#include "buffer_pool.h"
+#include "copy_engine.h"
+#include "durability.h"
+#include "io_tune.h"
+#include "journal.h"
+#include "log.h"
+#include "progress.h"
+
+namespace CopyEngine {
+    static const u32 ring_size = 4;
+    static const u64 checkpoint_size = 0x800000; // bytes written between journal checkpoints
+    
+    typedef struct {
+        u8 *data = nullptr;
+        u64 offset = 0;
+        u32 chunk_size = 0;
+        u32 length = 0; // 0 marks the end of the stream
+    } CopyBuffer;
+    
+    // The reader fills free buffers in ring order and the writer drains them in the same order, so reads of the next
+    // chunks overlap with the write of the current one. When a checksum is wanted a hasher sits between the two and
+    // runs over each buffer while the neighbouring ones are being read and written.
+    typedef struct {
+        Handle src = 0;
+        Handle dest = 0;
+        u64 offset = 0; // where the copy starts, everything before it is already on dest
+        u64 size = 0;
+        u32 direction = 0;
+        u32 write_flags = 0;
+        CopyBuffer buffers[ring_size];
+        LightSemaphore free_slots;
+        LightSemaphore read_slots; // filled, waiting for the hasher
+        LightSemaphore full_slots;
+        LightLock lock;
+        bool hash = false;
+        bool write = true; // a checksum pass has no writer, the hasher hands buffers straight back to the reader
+        u32 crc = 0;
+        u64 written = 0; // end of the data on dest
+        Result read_result = 0;
+        Result write_result = 0;
+        bool cancel = false;
+    } CopyJob;
+    
+    static bool IsCancelled(CopyJob *job) {
+        LightLock_Lock(&job->lock);
+        bool cancel = job->cancel;
+        LightLock_Unlock(&job->lock);
+        return (cancel || Progress::IsCancelled());
+    }
+    
+    static void ReleaseFilled(CopyJob *job) {
+        LightSemaphore_Release(job->hash? &job->read_slots : &job->full_slots, 1);
+    }
+    
+    static void PushEnd(CopyJob *job, u32 index) {
+        LightSemaphore_Acquire(&job->free_slots, 1);
+        job->buffers[index].length = 0;
+        CopyEngine::ReleaseFilled(job);
+    }
+    
+    static void ReadThread(void *args) {
+        CopyJob *job = static_cast<CopyJob *>(args);
+        u64 offset = job->offset;
+        u32 index = 0;
+        
+        while ((offset < job->size) && (!CopyEngine::IsCancelled(job))) {
+            LightSemaphore_Acquire(&job->free_slots, 1);
+            
+            CopyBuffer &buffer = job->buffers[index];
+            // Only copies are measured, so only they take part in IOTune's probing.
+            buffer.chunk_size = job->write? IOTune::GetChunkSize(job->direction) : BufferPool::buffer_size;
+            u32 bytes_read = 0;
+            Result ret = FSFILE_Read(job->src, &bytes_read, offset, buffer.data, buffer.chunk_size);
+            
+            // A short file (truncated behind our back) ends the stream early rather than spinning on empty reads.
+            if ((R_FAILED(ret)) || (bytes_read == 0)) {
+                job->read_result = R_FAILED(ret)? ret : -1;
+                LightSemaphore_Release(&job->free_slots, 1);
+                break;
+            }
+            
+            buffer.offset = offset;
+            buffer.length = bytes_read;
+            offset += bytes_read;
+            index = (index + 1) % ring_size;
+            CopyEngine::ReleaseFilled(job);
+        }
+        
+        CopyEngine::PushEnd(job, index);
+    }
+    
+    static void HashThread(void *args) {
+        CopyJob *job = static_cast<CopyJob *>(args);
+        u32 index = 0;
+        bool end = false;
+        
+        while (!end) {
+            LightSemaphore_Acquire(&job->read_slots, 1);
+            
+            const CopyBuffer &buffer = job->buffers[index];
+            end = (buffer.length == 0);
+            
+            if ((!end) && (!CopyEngine::IsCancelled(job)))
+                job->crc = crc32(job->crc, buffer.data, buffer.length);
+                
+            index = (index + 1) % ring_size;
+            LightSemaphore_Release(job->write? &job->full_slots : &job->free_slots, 1);
+        }
+    }
+    
+    static void WriteThread(void *args) {
+        CopyJob *job = static_cast<CopyJob *>(args);
+        u32 index = 0;
+        u64 last_tick = svcGetSystemTick();
+        u64 last_checkpoint = job->offset;
+        
+        while (true) {
+            LightSemaphore_Acquire(&job->full_slots, 1);
+            
+            const CopyBuffer &buffer = job->buffers[index];
+            if (buffer.length == 0)
+                break;
+                
+            // Once cancelled (or failed) the remaining buffers are only drained so the reader can't block on a full ring.
+            if (!CopyEngine::IsCancelled(job)) {
+                u32 bytes_written = 0;
+                Result ret = FSFILE_Write(job->dest, &bytes_written, buffer.offset, buffer.data, buffer.length, job->write_flags);
+                
+                LightLock_Lock(&job->lock);
+                if (R_FAILED(ret)) {
+                    job->write_result = ret;
+                    job->cancel = true;
+                }
+                else
+                    job->written += bytes_written;
+                LightLock_Unlock(&job->lock);
+                
+                // The gap between completions is the pipeline's per-chunk cost. The first one runs from the start and so
+                // includes the initial read, which is what a file of a single chunk costs; skipping it would leave small
+                // files unmeasured.
+                u64 tick = svcGetSystemTick();
+                if (R_SUCCEEDED(ret))
+                    IOTune::Record(job->direction, buffer.chunk_size, bytes_written, tick - last_tick);
+                    
+                // Every so often dest is flushed and the journal told how far it got, so an interrupted copy can resume
+                // from here. The flush isn't counted against the chunk size that happened to be in use.
+                u64 end = buffer.offset + bytes_written;
+                if ((R_SUCCEEDED(ret)) && (Journal::IsActive()) && (end - last_checkpoint >= checkpoint_size) && (end < job->size)) {
+                    if (R_SUCCEEDED(FSFILE_Flush(job->dest)))
+                        Journal::Checkpoint(end);
+                        
+                    last_checkpoint = end;
+                    tick = svcGetSystemTick();
+                }
+                
+                last_tick = tick;
+                Progress::Add(bytes_written);
+            }
+            
+            index = (index + 1) % ring_size;
+            LightSemaphore_Release(&job->free_slots, 1);
+        }
+    }
+    
+    // The workers sit one step above the calling thread since they spend nearly all their time blocked on the FS. Run
+    // from the jobs worker (just below the UI thread) that puts them level with the UI thread.
+    // The system core is preferred so they don't compete with rendering, the app core is used where it isn't available.
+    static Thread CreateThread(ThreadFunc func, void *args) {
+        s32 prio = 0;
+        svcGetThreadPriority(&prio, CUR_THREAD_HANDLE);
+        
+        Thread thread = threadCreate(func, args, 8 * 1024, prio - 1, 1, false);
+        if (!thread)
+            thread = threadCreate(func, args, 8 * 1024, prio - 1, -2, false);
+            
+        return thread;
+    }
+    
+    static void InitJob(CopyJob &job, Handle src, Handle dest, u64 offset, u64 size, u32 direction, bool hash) {
+        job.src = src;
+        job.dest = dest;
+        job.offset = offset;
+        job.written = offset;
+        job.size = size;
+        job.direction = direction;
+        job.hash = hash;
+        job.write = (dest != 0);
+        job.write_flags = Durability::GetWriteFlags(DurabilityCopy);
+        LightSemaphore_Init(&job.free_slots, ring_size, ring_size);
+        LightSemaphore_Init(&job.read_slots, 0, ring_size);
+        LightSemaphore_Init(&job.full_slots, 0, ring_size);
+        LightLock_Init(&job.lock);
+        
+        // Pool buffers fit the largest chunk IOTune hands out, whichever it settles on for this direction.
+        for (u32 i = 0; i < ring_size; i++) {
+            if (!(job.buffers[i].data = BufferPool::Checkout()))
+                job.read_result = -1;
+        }
+    }
+    
+    static void ReleaseBuffers(CopyJob &job) {
+        for (u32 i = 0; i < ring_size; i++) {
+            BufferPool::Return(job.buffers[i].data);
+            job.buffers[i].data = nullptr;
+        }
+    }
+    
+    static void JoinThread(Thread thread) {
+        if (thread) {
+            threadJoin(thread, U64_MAX);
+            threadFree(thread);
+        }
+    }
+    
+    // Starts the pipeline's threads in the order they consume buffers, so none can be left waiting on a stage that
+    // never started. Returns once every stage has finished.
+    static void RunJob(CopyJob &job) {
+        Thread reader = nullptr, hasher = nullptr, writer = nullptr;
+        
+        // Without its buffers there is nothing to run.
+        if (R_FAILED(job.read_result)) {
+            CopyEngine::ReleaseBuffers(job);
+            return;
+        }
+        
+        if ((job.write) && (!(writer = CopyEngine::CreateThread(CopyEngine::WriteThread, &job)))) {
+            Log::Error("threadCreate(WriteThread) failed\n");
+            job.write_result = -1;
+        }
+        else if ((job.hash) && (!(hasher = CopyEngine::CreateThread(CopyEngine::HashThread, &job)))) {
+            Log::Error("threadCreate(HashThread) failed\n");
+            job.read_result = -1;
+            job.hash = false;
+            
+            if (job.write)
+                CopyEngine::PushEnd(&job, 0);
+        }
+        else if (!(reader = CopyEngine::CreateThread(CopyEngine::ReadThread, &job))) {
+            Log::Error("threadCreate(ReadThread) failed\n");
+            job.read_result = -1;
+            
+            if ((job.write) || (job.hash))
+                CopyEngine::PushEnd(&job, 0);
+        }
+        
+        CopyEngine::JoinThread(writer);
+        CopyEngine::JoinThread(hasher);
+        CopyEngine::JoinThread(reader);
+        CopyEngine::ReleaseBuffers(job);
+    }
+    
+    // Copies size bytes from src to dest starting at offset, reporting progress for name until done or cancelled.
+    // Chunk sizes come from IOTune for the given direction. Writes are only flushed individually if DurabilityCopy asks
+    // for it, otherwise dest is flushed at each journal checkpoint and then as the caller closes it. If crc isn't null it
+    // receives the CRC32 of the data read from src.
+    Result Copy(Handle src, Handle dest, u64 offset, u64 size, u32 direction, const std::string &name, u32 *crc, CopyStats *stats) {
+        CopyJob job;
+        CopyEngine::InitJob(job, src, dest, offset, size, direction, crc != nullptr);
+        
+        Progress::SetItem(name, size);
+        Progress::Add(offset);
+        u64 start_time = osGetTime();
+        CopyEngine::RunJob(job);
+        
+        if (crc)
+            *crc = job.crc;
+            
+        // Drop whatever lies past the last byte written, be it preallocated space or the tail of a larger file that
+        // was overwritten (opening an existing file for writing doesn't truncate it).
+        FSFILE_SetSize(dest, job.written);
+            
+        stats->bytes = job.written - offset;
+        stats->elapsed = osGetTime() - start_time;
+        stats->cancelled = Progress::IsCancelled();
+        
+        if (R_FAILED(job.read_result)) {
+            Log::Error("FSFILE_Read(%s) failed: 0x%x\n", name.c_str(), job.read_result);
+            return job.read_result;
+        }
+        
+        if (R_FAILED(job.write_result)) {
+            Log::Error("FSFILE_Write(%s) failed: 0x%x\n", name.c_str(), job.write_result);
+            return job.write_result;
+        }
+        
+        Log::Debug("CopyEngine::Copy(%s): %llu bytes in %llu ms (%.2f MB/s)\n", name.c_str(), stats->bytes, stats->elapsed, 
+            static_cast<double>(CopyEngine::GetThroughput(*stats)) / (1024.0 * 1024.0));
+        return 0;
+    }
+    
+    // Computes the CRC32 of size bytes of handle from offset, the read and the hashing overlap like a copy's. Reads are
+    // always a whole pool buffer, a read only pass has nothing to tune.
+    Result Checksum(Handle handle, u64 offset, u64 size, u32 *crc) {
+        CopyJob job;
+        CopyEngine::InitJob(job, handle, 0, offset, size, 0, true);
+        CopyEngine::RunJob(job);
+        *crc = job.crc;
+        
+        if (R_FAILED(job.read_result)) {
+            Log::Error("FSFILE_Read(Checksum) failed: 0x%x\n", job.read_result);
+            return job.read_result;
+        }
+        
+        return 0;
+    }
+    
+    // Returns bytes per second.
+    u64 GetThroughput(const CopyStats &stats) {
+        return (stats.bytes * 1000) / (stats.elapsed > 0? stats.elapsed : 1);
+    }
+}
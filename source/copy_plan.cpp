@@ -0,0 +1,413 @@
+#include <vector>
+#include <zlib.h>
+
+#include "buffer_pool.h"
+#include "config.h"
+#include "copy_engine.h"
+#include "copy_plan.h"
+#include "durability.h"
+#include "fs.h"
+#include "io_tune.h"
+#include "journal.h"
+#include "log.h"
+#include "progress.h"
+#include "unicode.h"
+
+namespace CopyPlan {
+    // Files up to small_file_size are read back to back into one batch buffer (a pool buffer) and then written out,
+    // skipping the copy engine's thread setup and the extra size query that dominate for thousands of tiny files.
+    static const u64 small_file_size = 0x10000;
+    static const u32 batch_size = BufferPool::buffer_size;
+    static const u32 max_retries = 2; // copies of a file that fails verification before giving up on it
+    
+    typedef struct {
+        u32 index = 0;
+        u32 offset = 0;
+        u32 length = 0;
+        Result result = 0;
+        bool done = false; // written (and verified) in full
+    } CopyBatchItem;
+    
+    // Space is allocated in whole clusters, so every file is rounded up and every directory (plus the copy's root) is
+    // counted as one cluster. This errs on the side of refusing a copy that would only just fit. Files the destination
+    // keeps (skip) need nothing, ones written over are still counted in full.
+    Result CheckSpace(FS_Archive archive, const TreeManifest &manifest, const std::vector<u8> &skip) {
+        Result ret = 0;
+        FS_ArchiveResource resource = { 0 };
+        FS_SystemMediaType mediatype = archive == nand_archive? SYSTEM_MEDIATYPE_CTR_NAND : SYSTEM_MEDIATYPE_SD;
+        
+        if (R_FAILED(ret = FSUSER_GetArchiveResource(&resource, mediatype))) {
+            Log::Error("FSUSER_GetArchiveResource(CheckSpace) failed: 0x%x\n", ret);
+            return ret;
+        }
+        
+        u64 cluster_size = resource.clusterSize > 0? resource.clusterSize : 1;
+        u64 required = (manifest.num_dirs + 1) * cluster_size;
+        
+        for (u32 i = 0; i < manifest.Size(); i++) {
+            if ((!manifest.IsDir(i)) && (!skip[i]))
+                required += ((manifest.GetSize(i) + cluster_size - 1) / cluster_size) * cluster_size;
+        }
+        
+        u64 free = static_cast<u64>(resource.freeClusters) * cluster_size;
+        if (free < required) {
+            Log::Error("Not enough storage is available: %llu bytes required, %llu bytes free\n", required, free);
+            return -1;
+        }
+        
+        return 0;
+    }
+    
+    // Creates the destination root and every directory in the manifest ahead of the data, existing ones are left alone.
+    void CreateDirs(FS_Archive archive, PathBuilder &dest_path, const TreeManifest &manifest) {
+        FSUSER_CreateDirectory(archive, dest_path.GetPath(), 0);
+        
+        for (u32 i = 0; i < manifest.Size(); i++) {
+            if (!manifest.IsDir(i))
+                continue;
+                
+            u32 length = dest_path.Append(manifest.GetPath(i));
+            FSUSER_CreateDirectory(archive, dest_path.GetPath(), 0);
+            dest_path.Truncate(length);
+        }
+    }
+    
+    // A single file copy is planned as one entry with an empty path, the roots are the file itself.
+    static u32 AppendPath(PathBuilder &path, const char16_t *rel_path) {
+        return rel_path[0] != u'\0'? path.Append(rel_path) : path.Length();
+    }
+    
+    // Re-reads what was just written to dest and compares it with the checksum taken while reading src, copying the file
+    // again on a mismatch. Only the range this copy wrote is checked, a resumed file's earlier part was flushed before.
+    static Result VerifyFile(Handle src, Handle dest, u64 offset, u64 size, u32 direction, const char *filename, u32 crc) {
+        Result ret = 0;
+        u32 mismatches = 0;
+        u64 start_time = osGetTime();
+        
+        for (u32 attempt = 0; !Progress::IsCancelled(); attempt++) {
+            u32 dest_crc = 0;
+            Progress::SetItem(std::string("Verifying ") + filename, 0);
+            
+            if ((R_FAILED(ret = CopyEngine::Checksum(dest, offset, size, &dest_crc))) || (Progress::IsCancelled()) || (dest_crc == crc))
+                break;
+                
+            mismatches++;
+            if (attempt == max_retries) {
+                Log::Error("Verify(%s): checksum 0x%08lx, expected 0x%08lx, giving up\n", filename, dest_crc, crc);
+                ret = -1;
+                break;
+            }
+            
+            Log::Error("Verify(%s): checksum 0x%08lx, expected 0x%08lx, copying again\n", filename, dest_crc, crc);
+            Progress::AddTotal(size - offset, 0);
+            
+            CopyStats stats;
+            if (R_FAILED(ret = CopyEngine::Copy(src, dest, offset, size, direction, filename, &crc, &stats)))
+                break;
+        }
+        
+        Progress::AddVerify(osGetTime() - start_time, mismatches);
+        return ret;
+    }
+    
+    // offset is how much of the file the journal says is already on the destination.
+    static Result CopyFile(FS_Archive src_archive, FS_Archive dest_archive, const PathBuilder &src_path, const PathBuilder &dest_path, u64 offset, 
+        bool verify) {
+        Result ret = 0;
+        Handle src_handle, dest_handle;
+        
+        if (R_FAILED(ret = FSUSER_OpenFile(&src_handle, src_archive, src_path.GetPath(), FS_OPEN_READ, 0))) {
+            Log::Error("FSUSER_OpenFile(%s) failed: 0x%x\n", src_path.ToUTF8().c_str(), ret);
+            return ret;
+        }
+        
+        u64 size = 0;
+        if (R_FAILED(ret = FSFILE_GetSize(src_handle, &size))) {
+            Log::Error("FSFILE_GetSize(%s) failed: 0x%x\n", src_path.ToUTF8().c_str(), ret);
+            FSFILE_Close(src_handle);
+            return ret;
+        }
+        
+        // This may fail or not, but we don't care -> create the file if it doesn't exist, otherwise continue.
+        FSUSER_CreateFile(dest_archive, dest_path.GetPath(), 0, size);
+        
+        if (R_FAILED(ret = FSUSER_OpenFile(&dest_handle, dest_archive, dest_path.GetPath(), verify? (FS_OPEN_READ | FS_OPEN_WRITE) : FS_OPEN_WRITE, 0))) {
+            Log::Error("FSUSER_OpenFile(%s) failed: 0x%x\n", dest_path.ToUTF8().c_str(), ret);
+            FSFILE_Close(src_handle);
+            return ret;
+        }
+        
+        // Don't trust an offset past the end of what's actually there, or into a source that has since shrunk.
+        u64 dest_size = 0;
+        if ((offset > 0) && ((R_FAILED(FSFILE_GetSize(dest_handle, &dest_size))) || (dest_size < offset) || (size < offset)))
+            offset = 0;
+            
+        const char16_t *name = src_path.GetName();
+        char filename[(0x106 * 3) + 1];
+        Unicode::UTF16ToUTF8(filename, sizeof(filename), name, std::char_traits<char16_t>::length(name));
+        
+        CopyStats stats;
+        u32 crc = 0, direction = IOTune::GetDirection(src_archive, dest_archive);
+        ret = CopyEngine::Copy(src_handle, dest_handle, offset, size, direction, filename, verify? &crc : nullptr, &stats);
+        
+        if ((verify) && (R_SUCCEEDED(ret)) && (!Progress::IsCancelled()))
+            ret = CopyPlan::VerifyFile(src_handle, dest_handle, offset, size, direction, filename, crc);
+            
+        FSFILE_Close(src_handle);
+        Durability::Close(DurabilityCopy, dest_handle);
+        return ret;
+    }
+    
+    // One extra byte is asked for, so a file that grew since it was listed reads long and is handed to the copy engine.
+    static Result ReadSmallFile(FS_Archive archive, const PathBuilder &path, u8 *buf, u64 size, u32 *length) {
+        Result ret = 0;
+        Handle handle;
+        
+        if (R_FAILED(ret = FSUSER_OpenFile(&handle, archive, path.GetPath(), FS_OPEN_READ, 0))) {
+            Log::Error("FSUSER_OpenFile(%s) failed: 0x%x\n", path.ToUTF8().c_str(), ret);
+            return ret;
+        }
+        
+        if (R_FAILED(ret = FSFILE_Read(handle, length, 0, buf, size + 1)))
+            Log::Error("FSFILE_Read(%s) failed: 0x%x\n", path.ToUTF8().c_str(), ret);
+            
+        FSFILE_Close(handle);
+        return ret;
+    }
+    
+    static Result WriteSmallFile(FS_Archive archive, const PathBuilder &path, const u8 *buf, u32 length) {
+        Result ret = 0;
+        Handle handle;
+        
+        FSUSER_CreateFile(archive, path.GetPath(), 0, length);
+        
+        if (R_FAILED(ret = FSUSER_OpenFile(&handle, archive, path.GetPath(), FS_OPEN_WRITE, 0))) {
+            Log::Error("FSUSER_OpenFile(%s) failed: 0x%x\n", path.ToUTF8().c_str(), ret);
+            return ret;
+        }
+        
+        u32 bytes_written = 0;
+        if (R_FAILED(ret = FSFILE_Write(handle, &bytes_written, 0, buf, length, Durability::GetWriteFlags(DurabilityCopy))))
+            Log::Error("FSFILE_Write(%s) failed: 0x%x\n", path.ToUTF8().c_str(), ret);
+        else if (R_FAILED(ret = FSFILE_SetSize(handle, length)))
+            Log::Error("FSFILE_SetSize(%s) failed: 0x%x\n", path.ToUTF8().c_str(), ret);
+            
+        Durability::Close(DurabilityCopy, handle);
+        return ret;
+    }
+    
+    // The small file counterpart of VerifyFile(), data is still in the batch buffer so a mismatch is simply written again.
+    static Result VerifySmallFile(FS_Archive archive, const PathBuilder &path, const u8 *data, u32 length, u8 *verify_buf) {
+        Result ret = 0;
+        u32 mismatches = 0;
+        u32 crc = crc32(0, data, length);
+        u64 start_time = osGetTime();
+        
+        for (u32 attempt = 0; ; attempt++) {
+            u32 read_length = 0;
+            if (R_FAILED(ret = CopyPlan::ReadSmallFile(archive, path, verify_buf, length, &read_length)))
+                break;
+                
+            u32 dest_crc = crc32(0, verify_buf, read_length);
+            if ((read_length == length) && (dest_crc == crc))
+                break;
+                
+            mismatches++;
+            if (attempt == max_retries) {
+                Log::Error("Verify(%s): checksum 0x%08lx, expected 0x%08lx, giving up\n", path.ToUTF8().c_str(), dest_crc, crc);
+                ret = -1;
+                break;
+            }
+            
+            Log::Error("Verify(%s): checksum 0x%08lx, expected 0x%08lx, writing again\n", path.ToUTF8().c_str(), dest_crc, crc);
+            if (R_FAILED(ret = CopyPlan::WriteSmallFile(archive, path, data, length)))
+                break;
+        }
+        
+        Progress::AddVerify(osGetTime() - start_time, mismatches);
+        return ret;
+    }
+    
+    // A move only deletes a source file once its copy has been recorded as complete, so a failure at any point leaves
+    // every file in at least one place.
+    static void DeleteSource(FS_Archive archive, const PathBuilder &path) {
+        Result ret = 0;
+        
+        if (R_FAILED(ret = FSUSER_DeleteFile(archive, path.GetPath())))
+            Log::Error("FSUSER_DeleteFile(%s) failed: 0x%x\n", path.ToUTF8().c_str(), ret);
+    }
+    
+    // Reads every file in the batch into buf, then writes them all out. Reads and writes are grouped so each archive
+    // sees a run of requests rather than alternating between the two. verify_buf is null unless the copy is verified.
+    static Result CopyBatch(FS_Archive src_archive, FS_Archive dest_archive, const TreeManifest &manifest, std::vector<CopyBatchItem> &batch, 
+        u8 *buf, u8 *verify_buf, PathBuilder &src_path, PathBuilder &dest_path, bool move) {
+        Result ret = 0;
+        
+        for (CopyBatchItem &item : batch) {
+            u32 length = CopyPlan::AppendPath(src_path, manifest.GetPath(item.index));
+            item.result = CopyPlan::ReadSmallFile(src_archive, src_path, &buf[item.offset], manifest.GetSize(item.index), &item.length);
+            src_path.Truncate(length);
+        }
+        
+        for (CopyBatchItem &item : batch) {
+            if (Progress::IsCancelled())
+                break;
+                
+            u32 src_length = CopyPlan::AppendPath(src_path, manifest.GetPath(item.index));
+            u32 dest_length = CopyPlan::AppendPath(dest_path, manifest.GetPath(item.index));
+            Result item_ret = item.result;
+            
+            if (R_SUCCEEDED(item_ret)) {
+                if (item.length > manifest.GetSize(item.index))
+                    item_ret = CopyPlan::CopyFile(src_archive, dest_archive, src_path, dest_path, 0, verify_buf != nullptr);
+                else {
+                    Progress::SetItem(Unicode::ToUTF8(src_path.GetName(), std::char_traits<char16_t>::length(src_path.GetName())), item.length);
+                    
+                    if (R_SUCCEEDED(item_ret = CopyPlan::WriteSmallFile(dest_archive, dest_path, &buf[item.offset], item.length))) {
+                        Progress::Add(item.length);
+                        
+                        if (verify_buf)
+                            item_ret = CopyPlan::VerifySmallFile(dest_archive, dest_path, &buf[item.offset], item.length, verify_buf);
+                    }
+                }
+            }
+            
+            if ((R_FAILED(item_ret)) && (R_SUCCEEDED(ret)))
+                ret = item_ret;
+                
+            if ((R_SUCCEEDED(item_ret)) && (!Progress::IsCancelled())) {
+                Journal::Complete(item.index);
+                item.done = true;
+            }
+                
+            Progress::ItemDone(item_ret);
+            src_path.Truncate(src_length);
+            dest_path.Truncate(dest_length);
+        }
+        
+        // Each file was closed after being written, so the whole batch can be recorded with one journal write.
+        Journal::Sync();
+        
+        for (u32 i = 0; (move) && (i < batch.size()); i++) {
+            if (!batch[i].done)
+                continue;
+                
+            u32 length = CopyPlan::AppendPath(src_path, manifest.GetPath(batch[i].index));
+            CopyPlan::DeleteSource(src_archive, src_path);
+            src_path.Truncate(length);
+        }
+        
+        batch.clear();
+        return ret;
+    }
+    
+    // Copies every file in the manifest, src_path and dest_path are the copy's roots and are restored before returning.
+    // A failed file doesn't stop the rest, the first failure is returned once everything has been tried. A move deletes
+    // each source file as soon as its copy is complete. Files marked in skip are left alone on both sides.
+    Result Run(FS_Archive src_archive, FS_Archive dest_archive, const TreeManifest &manifest, const std::vector<u8> &skip, PathBuilder &src_path, 
+        PathBuilder &dest_path, bool move) {
+        Result ret = 0, item_ret = 0;
+        std::vector<CopyBatchItem> batch;
+        u8 *buf = BufferPool::Checkout();
+        
+        // The setting is read once so a job is either verified throughout or not at all.
+        bool verify = cfg.verify_copy;
+        u8 *verify_buf = verify? BufferPool::Checkout(small_file_size + 1) : nullptr;
+        
+        if ((!buf) || ((verify) && (!verify_buf))) {
+            BufferPool::Return(verify_buf);
+            BufferPool::Return(buf);
+            return -1;
+        }
+        
+        u32 used = 0;
+        
+        for (u32 i = 0; (i < manifest.Size()) && (!Progress::IsCancelled()); i++) {
+            if (manifest.IsDir(i))
+                continue;
+                
+            if (skip[i]) {
+                Progress::AddSkipped(1, manifest.GetSize(i));
+                continue;
+            }
+            
+            // Finished before the job was interrupted. A move may not have got round to deleting the source yet.
+            if (Journal::IsComplete(i)) {
+                if (move) {
+                    u32 length = CopyPlan::AppendPath(src_path, manifest.GetPath(i));
+                    FSUSER_DeleteFile(src_archive, src_path.GetPath());
+                    src_path.Truncate(length);
+                }
+                
+                Progress::Add(manifest.GetSize(i));
+                Progress::ItemDone(0);
+                continue;
+            }
+            
+            u64 size = manifest.GetSize(i);
+            if (size <= small_file_size) {
+                if (used + size + 1 > batch_size) {
+                    if ((R_FAILED(item_ret = CopyPlan::CopyBatch(src_archive, dest_archive, manifest, batch, buf, verify_buf, src_path, dest_path, move))) && (R_SUCCEEDED(ret)))
+                        ret = item_ret;
+                        
+                    used = 0;
+                }
+                
+                CopyBatchItem item;
+                item.index = i;
+                item.offset = used;
+                batch.push_back(item);
+                used += size + 1;
+                continue;
+            }
+            
+            u32 src_length = CopyPlan::AppendPath(src_path, manifest.GetPath(i));
+            u32 dest_length = CopyPlan::AppendPath(dest_path, manifest.GetPath(i));
+            
+            Journal::SetFile(i);
+            if (R_FAILED(item_ret = CopyPlan::CopyFile(src_archive, dest_archive, src_path, dest_path, Journal::GetOffset(i), verify))) {
+                Log::Error("Copy(%s) failed: 0x%x\n", src_path.ToUTF8().c_str(), item_ret);
+                
+                if (R_SUCCEEDED(ret))
+                    ret = item_ret;
+            }
+            else if (!Progress::IsCancelled()) {
+                Journal::Complete(i);
+                Journal::Sync();
+                
+                if (move)
+                    CopyPlan::DeleteSource(src_archive, src_path);
+            }
+            
+            Journal::SetFile(-1);
+
+            Progress::ItemDone(item_ret);
+            src_path.Truncate(src_length);
+            dest_path.Truncate(dest_length);
+        }
+        
+        if ((!batch.empty()) && (!Progress::IsCancelled())) {
+            if ((R_FAILED(item_ret = CopyPlan::CopyBatch(src_archive, dest_archive, manifest, batch, buf, verify_buf, src_path, dest_path, move))) && (R_SUCCEEDED(ret)))
+                ret = item_ret;
+        }
+        
+        BufferPool::Return(verify_buf);
+        BufferPool::Return(buf);
+        return ret;
+    }
+    
+    // Removes the source folders a move has emptied, contents first. Folders still holding a file that couldn't be moved
+    // fail to delete and are left where they are.
+    void RemoveDirs(FS_Archive archive, PathBuilder &src_path, const TreeManifest &manifest) {
+        for (u32 i = manifest.Size(); i-- > 0;) {
+            if (!manifest.IsDir(i))
+                continue;
+                
+            u32 length = src_path.Append(manifest.GetPath(i));
+            FSUSER_DeleteDirectory(archive, src_path.GetPath());
+            src_path.Truncate(length);
+        }
+        
+        FSUSER_DeleteDirectory(archive, src_path.GetPath());
+    }
+}
@@ -0,0 +1,112 @@
+#include <algorithm>
+#include <list>
+
+#include "dir_cache.h"
+#include "log.h"
+
+namespace DirCache {
+    typedef struct {
+        FS_Archive archive = 0;
+        std::string path;
+        int sort = 0;
+        DirList entries;
+        std::size_t size = 0;
+    } DirCacheEntry;
+    
+    // Listings are kept most recently used first and evicted from the back once they outgrow the budget.
+    static const std::size_t budget = 0x400000;
+    static std::list<DirCacheEntry> cache;
+    static std::size_t used = 0;
+    static u32 hits = 0, misses = 0;
+    
+    static std::size_t GetSize(const DirCacheEntry &entry) {
+        return sizeof(DirCacheEntry) + entry.path.capacity() + entry.entries.GetMemoryUsage();
+    }
+    
+    static std::list<DirCacheEntry>::iterator Find(FS_Archive archive, const std::string &path) {
+        return std::find_if(cache.begin(), cache.end(), [archive, &path](const DirCacheEntry &entry) {
+            return ((entry.archive == archive) && (!entry.path.compare(path)));
+        });
+    }
+    
+    static void Erase(std::list<DirCacheEntry>::iterator it) {
+        used -= it->size;
+        cache.erase(it);
+    }
+    
+    bool Get(FS_Archive archive, const std::string &path, DirList &entries, int *sort) {
+        auto it = DirCache::Find(archive, path);
+        
+        if (it == cache.end()) {
+            misses++;
+            Log::Debug("DirCache::Get(%s) miss (%lu hits, %lu misses)\n", path.c_str(), hits, misses);
+            return false;
+        }
+        
+        cache.splice(cache.begin(), cache, it);
+        entries = it->entries;
+        *sort = it->sort;
+        hits++;
+        Log::Debug("DirCache::Get(%s) hit (%lu hits, %lu misses)\n", path.c_str(), hits, misses);
+        return true;
+    }
+    
+    bool Take(FS_Archive archive, const std::string &path, DirList &entries, int *sort) {
+        auto it = DirCache::Find(archive, path);
+        
+        if (it == cache.end())
+            return false;
+            
+        entries = std::move(it->entries);
+        *sort = it->sort;
+        DirCache::Erase(it);
+        return true;
+    }
+    
+    void Put(FS_Archive archive, const std::string &path, int sort, DirList entries) {
+        DirCache::Invalidate(archive, path);
+        
+        DirCacheEntry entry;
+        entry.archive = archive;
+        entry.path = path;
+        entry.sort = sort;
+        entry.entries = std::move(entries);
+        entry.size = DirCache::GetSize(entry);
+        
+        if (entry.size > budget)
+            return;
+            
+        used += entry.size;
+        cache.push_front(std::move(entry));
+        
+        while (used > budget)
+            DirCache::Erase(std::prev(cache.end()));
+    }
+    
+    void Invalidate(FS_Archive archive, const std::string &path) {
+        auto it = DirCache::Find(archive, path);
+        
+        if (it != cache.end())
+            DirCache::Erase(it);
+    }
+    
+    // Drops the listing of path and of every directory below it. path is expected to end with a '/'.
+    void InvalidateTree(FS_Archive archive, const std::string &path) {
+        for (auto it = cache.begin(); it != cache.end();) {
+            if ((it->archive == archive) && (!it->path.compare(0, path.length(), path)))
+                DirCache::Erase(it++);
+            else
+                ++it;
+        }
+    }
+    
+    void Clear(void) {
+        cache.clear();
+        used = 0;
+    }
+    
+    void GetStats(u32 *hits, u32 *misses) {
+        *hits = DirCache::hits;
+        *misses = DirCache::misses;
+    }
+}
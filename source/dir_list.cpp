@@ -0,0 +1,147 @@
+#include <cstring>
+
+#include "dir_list.h"
+#include "fs.h"
+#include "unicode.h"
+
+// Longest label (in bytes) that fits the file browser's row next to the icons.
+static const u32 max_label_length = 52;
+
+static void AppendString(std::vector<char> &strings, const char *string, u32 length) {
+    strings.insert(strings.end(), string, string + length);
+    strings.push_back('\0');
+}
+
+// Converts the name at index and appends its UTF-8 form, display label and file type.
+static void AddMetadata(DirList &list, u32 index) {
+    const char16_t *name_u16 = list.GetName(index);
+    char name[(0x106 * 3) + 1];
+    u32 name_length = Unicode::UTF16ToUTF8(name, sizeof(name), name_u16, std::char_traits<char16_t>::length(name_u16));
+    
+    list.utf8_offsets[index] = list.strings.size();
+    AppendString(list.strings, name, name_length);
+    list.label_offsets[index] = list.utf8_offsets[index];
+    
+    if (name_length > max_label_length) {
+        // Cut on a character boundary rather than in the middle of a multi-byte sequence.
+        u32 length = max_label_length;
+        while ((length > 0) && ((name[length] & 0xC0) == 0x80))
+            length--;
+            
+        std::memcpy(&name[length], "...", 3);
+        list.label_offsets[index] = list.strings.size();
+        AppendString(list.strings, name, length + 3);
+    }
+    
+    list.types[index] = list.IsDir(index)? FileTypeNone : FS::GetFileType(list.GetUTF8Name(index));
+}
+
+void DirList::Clear(void) {
+    names.clear();
+    strings.clear();
+    name_offsets.clear();
+    utf8_offsets.clear();
+    label_offsets.clear();
+    attributes.clear();
+    sizes.clear();
+    types.clear();
+}
+
+void DirList::Add(const char16_t *name, u32 attributes, u64 size) {
+    name_offsets.push_back(names.size());
+    names.insert(names.end(), name, name + std::char_traits<char16_t>::length(name) + 1);
+    utf8_offsets.push_back(0);
+    label_offsets.push_back(0);
+    this->attributes.push_back(attributes);
+    sizes.push_back(size);
+    types.push_back(FileTypeNone);
+    AddMetadata(*this, this->Size() - 1);
+}
+
+void DirList::Add(const FS_DirectoryEntry &entry) {
+    this->Add(reinterpret_cast<const char16_t *>(entry.name), entry.attributes, entry.fileSize);
+}
+
+void DirList::Append(const DirList &list) {
+    u32 names_base = names.size(), strings_base = strings.size();
+    names.insert(names.end(), list.names.begin(), list.names.end());
+    strings.insert(strings.end(), list.strings.begin(), list.strings.end());
+    
+    for (u32 i = 0; i < list.Size(); i++) {
+        name_offsets.push_back(names_base + list.name_offsets[i]);
+        utf8_offsets.push_back(strings_base + list.utf8_offsets[i]);
+        label_offsets.push_back(strings_base + list.label_offsets[i]);
+    }
+        
+    attributes.insert(attributes.end(), list.attributes.begin(), list.attributes.end());
+    sizes.insert(sizes.end(), list.sizes.begin(), list.sizes.end());
+    types.insert(types.end(), list.types.begin(), list.types.end());
+}
+
+// The old name stays in the pools until the next Gather() compacts them.
+void DirList::Remove(u32 index) {
+    name_offsets.erase(name_offsets.begin() + index);
+    utf8_offsets.erase(utf8_offsets.begin() + index);
+    label_offsets.erase(label_offsets.begin() + index);
+    attributes.erase(attributes.begin() + index);
+    sizes.erase(sizes.begin() + index);
+    types.erase(types.begin() + index);
+}
+
+void DirList::SetName(u32 index, const std::u16string &name) {
+    name_offsets[index] = names.size();
+    names.insert(names.end(), name.c_str(), name.c_str() + name.length() + 1);
+    AddMetadata(*this, index);
+}
+
+int DirList::Find(const std::u16string &name) const {
+    for (u32 i = 0; i < this->Size(); i++) {
+        if (!name.compare(this->GetName(i)))
+            return i;
+    }
+    
+    return -1;
+}
+
+// Rebuilds every array in the given order, which also drops names orphaned by Remove() and SetName().
+// The derived strings are copied over as they are, nothing is converted again.
+void DirList::Gather(const std::vector<u32> &order) {
+    DirList list;
+    list.names.reserve(names.size());
+    list.strings.reserve(strings.size());
+    list.name_offsets.reserve(order.size());
+    list.utf8_offsets.reserve(order.size());
+    list.label_offsets.reserve(order.size());
+    list.attributes.reserve(order.size());
+    list.sizes.reserve(order.size());
+    list.types.reserve(order.size());
+    
+    for (u32 index : order) {
+        const char16_t *name = this->GetName(index);
+        list.name_offsets.push_back(list.names.size());
+        list.names.insert(list.names.end(), name, name + std::char_traits<char16_t>::length(name) + 1);
+        
+        list.utf8_offsets.push_back(list.strings.size());
+        AppendString(list.strings, this->GetUTF8Name(index), std::strlen(this->GetUTF8Name(index)));
+        
+        if (label_offsets[index] == utf8_offsets[index])
+            list.label_offsets.push_back(list.utf8_offsets.back());
+        else {
+            list.label_offsets.push_back(list.strings.size());
+            AppendString(list.strings, this->GetLabel(index), std::strlen(this->GetLabel(index)));
+        }
+        
+        list.attributes.push_back(attributes[index]);
+        list.sizes.push_back(sizes[index]);
+        list.types.push_back(types[index]);
+    }
+        
+    list.names.shrink_to_fit();
+    list.strings.shrink_to_fit();
+    std::swap(*this, list);
+}
+
+std::size_t DirList::GetMemoryUsage(void) const {
+    return (names.capacity() * sizeof(char16_t)) + strings.capacity() + ((name_offsets.capacity() + utf8_offsets.capacity()
+        + label_offsets.capacity() + attributes.capacity()) * sizeof(u32)) + (sizes.capacity() * sizeof(u64)) + types.capacity();
+}
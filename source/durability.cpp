@@ -0,0 +1,70 @@
+#include "config.h"
+#include "durability.h"
+#include "log.h"
+
+// Closing a file commits it too, so the modes only decide how often a flush is asked for on top of that. There is no
+// flush for a whole archive, so a deferred copy's files are simply left to their close. Bulk copies default to that, and
+// the small files the app keeps its own state in to flushing every write.
+namespace Durability {
+    static const char *names[] = {
+        "Per chunk",
+        "At file close",
+        "Deferred"
+    };
+    
+    static const char *summaries[] = {
+        "flushed per chunk",
+        "flushed at file close",
+        "flushing deferred"
+    };
+    
+    DurabilityMode GetMode(DurabilityClass type) {
+        int mode = 0;
+        
+        switch(type) {
+            case DurabilityCopy:
+                mode = cfg.copy_durability;
+                break;
+                
+            case DurabilityDownload:
+                mode = cfg.download_durability;
+                break;
+                
+            case DurabilityLog:
+                mode = cfg.log_durability;
+                break;
+                
+            case DurabilityState:
+                mode = cfg.state_durability;
+                break;
+        }
+        
+        return ((mode >= DurabilityChunk) && (mode <= DurabilityDeferred))? static_cast<DurabilityMode>(mode) : DurabilityChunk;
+    }
+    
+    const char *GetName(DurabilityMode mode) {
+        return names[mode];
+    }
+    
+    const char *GetSummary(DurabilityMode mode) {
+        return summaries[mode];
+    }
+    
+    // The flags for FSFILE_Write().
+    u32 GetWriteFlags(DurabilityClass type) {
+        return (Durability::GetMode(type) == DurabilityChunk)? FS_WRITE_FLUSH : 0;
+    }
+    
+    // Closes a file written to for type, flushing it first if that's what type asks for. job_end is set for the file an
+    // operation finishes with (a download, a job's journal). Only a failed flush is returned.
+    Result Close(DurabilityClass type, Handle handle, bool job_end) {
+        Result ret = 0;
+        DurabilityMode mode = Durability::GetMode(type);
+        
+        if (((mode == DurabilityClose) || ((job_end) && (mode == DurabilityDeferred))) && (R_FAILED(ret = FSFILE_Flush(handle))))
+            Log::Error("FSFILE_Flush failed: 0x%x\n", ret);
+            
+        FSFILE_Close(handle);
+        return ret;
+    }
+}
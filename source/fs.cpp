@@ -1,27 +1,44 @@
 #include <algorithm>
-#include <codecvt>
 #include <cstring>
 #include <filesystem>
-#include <locale>
+#include <numeric>
 
 #include "config.h"
+#include "conflict.h"
+#include "copy_plan.h"
+#include "dir_cache.h"
+#include "dir_list.h"
 #include "fs.h"
 #include "gui.h"
+#include "journal.h"
 #include "log.h"
+#include "path_builder.h"
+#include "progress.h"
+#include "tree_walk.h"
+#include "unicode.h"
 #include "utils.h"
 
 FS_Archive archive, sdmc_archive, nand_archive;
 
 namespace FS {
-    static FS_Archive src_archive;
+    static const u32 dir_read_batch = 64;
     
     typedef struct {
-        std::u16string  copy_path;
-        std::u16string copy_filename;
-        bool is_dir = false;
-    } FSCopyEntry;
+        Thread thread = nullptr;
+        Handle dir = 0;
+        FS_Archive archive = 0;
+        std::string path;
+        LightLock lock;
+        DirList pending;
+        u32 total = 0;
+        u64 start_time = 0;
+        u64 first_batch_time = 0;
+        Result result = 0;
+        bool cancel = false;
+        bool finished = false;
+    } FSDirListJob;
     
-    FSCopyEntry fs_copy_entry;
+    static FSDirListJob dir_list_job;
 
     Result OpenArchive(FS_Archive *archive, FS_ArchiveID id) {
         Result ret = 0;
@@ -43,7 +60,7 @@ namespace FS {
     
     bool FileExists(FS_Archive archive, const std::string &path) {
         Handle handle;
-        std::u16string path_u16 = std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t>{}.from_bytes(path.data());
+        std::u16string path_u16 = Unicode::ToUTF16(path);
         
         if (R_FAILED(FSUSER_OpenFile(&handle, archive, fsMakePath(PATH_UTF16, path_u16.c_str()), FS_OPEN_READ, 0)))
             return false;
@@ -56,7 +73,7 @@ namespace FS {
     
     bool DirExists(FS_Archive archive, const std::string &path) {
         Handle handle;
-        std::u16string path_u16 = std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t>{}.from_bytes(path.data());
+        std::u16string path_u16 = Unicode::ToUTF16(path);
         
         if (R_FAILED(FSUSER_OpenDirectory(&handle, archive, fsMakePath(PATH_UTF16, path_u16.c_str()))))
             return false;
@@ -87,18 +104,6 @@ namespace FS {
         return FileTypeNone;
     }
     
-    static u64 GetFreeStorage(FS_SystemMediaType mediatype) {
-        Result ret = 0;
-        FS_ArchiveResource resource = { 0 };
-        
-        if (R_FAILED(ret = FSUSER_GetArchiveResource(&resource, mediatype))) {
-            Log::Error("FSUSER_GetArchiveResource(GetFreeStorage) failed: 0x%x\n", ret);
-            return ret;
-        }
-            
-        return (static_cast<u64>(resource.freeClusters) * static_cast<u64>(resource.clusterSize));
-    }
-    
     u64 GetTotalStorage(FS_SystemMediaType mediatype) {
         Result ret = 0;
         FS_ArchiveResource resource = { 0 };
@@ -124,331 +129,677 @@ namespace FS {
             (static_cast<u64>(resource.freeClusters) * static_cast<u64>(resource.clusterSize)));
     }
     
-    static bool Sort(const FS_DirectoryEntry &entryA, const FS_DirectoryEntry &entryB) {
-        if ((entryA.attributes & FS_ATTRIBUTE_DIRECTORY) && !(entryB.attributes & FS_ATTRIBUTE_DIRECTORY))
-            return true;
-        else if (!(entryA.attributes & FS_ATTRIBUTE_DIRECTORY) && (entryB.attributes & FS_ATTRIBUTE_DIRECTORY))
-            return false;
-        else {
-            std::u16string entryA_name = reinterpret_cast<const char16_t *>(entryA.name);
-            std::u16string entryB_name = reinterpret_cast<const char16_t *>(entryB.name);
-            std::transform(entryA_name.begin(), entryA_name.end(), entryA_name.begin(), [](unsigned char c){ return std::tolower(c); });
-            std::transform(entryB_name.begin(), entryB_name.end(), entryB_name.begin(), [](unsigned char c){ return std::tolower(c); });
-
-            switch(cfg.sort) {
-                case 0: // Sort alphabetically (ascending - A to Z)
-                    if (entryA_name.compare(entryB_name) < 0)
-                        return true;
-                    break;
-                
-                case 1: // Sort alphabetically (descending - Z to A)
-                    if (entryB_name.compare(entryA_name) < 0)
-                        return true;
-                    break;
+    // Collation key computed once per entry before sorting. Names are case folded into a shared pool so
+    // the comparisons themselves never allocate.
+    typedef struct {
+        u32 name = 0;
+        u16 length = 0;
+        u16 ext = 0;
+        u64 size = 0;
+        FileType type = FileTypeNone;
+        bool dir = false;
+    } FSSortKey;
+    
+    static void GetSortKeys(const DirList &entries, std::vector<FSSortKey> &keys, std::vector<char16_t> &pool) {
+        keys.resize(entries.Size());
+        pool.clear();
+        pool.reserve(entries.names.size());
+        
+        for (u32 i = 0; i < entries.Size(); i++) {
+            FSSortKey &key = keys[i];
+            const char16_t *name = entries.GetName(i);
+            key.name = pool.size();
+            key.dir = entries.IsDir(i);
+            key.size = entries.GetSize(i);
+            
+            u32 ext = 0;
+            for (const char16_t *c = name; *c; c++) {
+                if (*c == u'.')
+                    ext = c - name;
                     
-                case 2: // Sort by file size (largest first)
-                    if (entryB.fileSize < entryA.fileSize)
-                        return true;
-                    break;
-                
-                case 3: // Sort by file size (smallest first)
-                    if (entryA.fileSize < entryB.fileSize)
-                        return true;
-                    break;
+                pool.push_back(((*c >= u'A') && (*c <= u'Z'))? (*c + (u'a' - u'A')) : *c);
+            }
+            
+            key.length = pool.size() - key.name;
+            key.ext = (ext > 0)? ext : key.length; // A leading dot marks a hidden file, not an extension.
+            key.type = entries.GetType(i);
+        }
+    }
+    
+    static int CompareNames(const char16_t *a, u32 a_length, const char16_t *b, u32 b_length) {
+        int ret = std::char_traits<char16_t>::compare(a, b, std::min(a_length, b_length));
+        
+        if (ret != 0)
+            return ret;
+            
+        return (a_length < b_length)? -1 : (a_length > b_length);
+    }
+    
+    static bool IsDigit(char16_t c) {
+        return ((c >= u'0') && (c <= u'9'));
+    }
+    
+    // Compares names with runs of digits ordered by their numeric value, so "img2" sorts before "img10".
+    static int CompareNatural(const char16_t *a, u32 a_length, const char16_t *b, u32 b_length) {
+        u32 i = 0, j = 0;
+        
+        while ((i < a_length) && (j < b_length)) {
+            if ((IsDigit(a[i])) && (IsDigit(b[j]))) {
+                while ((i < a_length) && (a[i] == u'0'))
+                    i++;
+                while ((j < b_length) && (b[j] == u'0'))
+                    j++;
+                    
+                u32 a_start = i, b_start = j;
+                while ((i < a_length) && (IsDigit(a[i])))
+                    i++;
+                while ((j < b_length) && (IsDigit(b[j])))
+                    j++;
+                    
+                // Without leading zeros the longer run is the larger number, equal lengths compare digit by digit.
+                if ((i - a_start) != (j - b_start))
+                    return ((i - a_start) < (j - b_start))? -1 : 1;
+                    
+                int ret = std::char_traits<char16_t>::compare(&a[a_start], &b[b_start], i - a_start);
+                if (ret != 0)
+                    return ret;
+                    
+                continue;
             }
+            
+            if (a[i] != b[j])
+                return (a[i] < b[j])? -1 : 1;
+                
+            i++;
+            j++;
         }
-        return false;
+        
+        return ((a_length - i) < (b_length - j))? -1 : ((a_length - i) > (b_length - j));
     }
     
-    Result GetDirList(const std::string &path, std::vector<FS_DirectoryEntry> &entries) {
-        if (!entries.empty())
-            entries.clear();
+    static bool Sort(const char16_t *pool, const FSSortKey &keyA, const FSSortKey &keyB) {
+        if (keyA.dir != keyB.dir)
+            return keyA.dir;
+            
+        const char16_t *nameA = &pool[keyA.name], *nameB = &pool[keyB.name];
+        int ret = 0;
+        
+        switch(cfg.sort) {
+            case 1: // Sort alphabetically (descending - Z to A)
+                return (FS::CompareNames(nameB, keyB.length, nameA, keyA.length) < 0);
+                
+            case 2: // Sort by file size (largest first)
+                if (keyA.size != keyB.size)
+                    return (keyB.size < keyA.size);
+                break;
+                
+            case 3: // Sort by file size (smallest first)
+                if (keyA.size != keyB.size)
+                    return (keyA.size < keyB.size);
+                break;
+                
+            case 4: // Sort by file extension
+                if ((ret = FS::CompareNames(&nameA[keyA.ext], keyA.length - keyA.ext, &nameB[keyB.ext], keyB.length - keyB.ext)) != 0)
+                    return (ret < 0);
+                break;
+                
+            case 5: // Sort by file type
+                if (keyA.type != keyB.type)
+                    return (keyA.type < keyB.type);
+                break;
+                
+            case 6: // Sort naturally (numbers by value), "img01" and "img1" are equal and fall through to the tie break
+                if ((ret = FS::CompareNatural(nameA, keyA.length, nameB, keyB.length)) != 0)
+                    return (ret < 0);
+                break;
+                
+            default:
+                break;
+        }
+        
+        // Sort alphabetically (ascending - A to Z), also used to break ties in the other modes.
+        return (FS::CompareNames(nameA, keyA.length, nameB, keyB.length) < 0);
+    }
+    
+    // Reads every remaining entry of an open directory, dir_read_batch entries per FSDIR_Read call.
+    // Each batch is packed into the listing straight away, so only one batch of full FS_DirectoryEntry structs is ever alive.
+    static Result ReadDirEntries(Handle dir, DirList &entries) {
+        Result ret = 0;
+        u32 entry_count = 0;
+        std::vector<FS_DirectoryEntry> batch(dir_read_batch);
+        
+        do {
+            if (R_FAILED(ret = FSDIR_Read(dir, &entry_count, dir_read_batch, batch.data())))
+                return ret;
+                
+            for (u32 i = 0; i < entry_count; i++)
+                entries.Add(batch[i]);
+        } while(entry_count > 0);
+        
+        return 0;
+    }
+    
+    // Cached listings sorted under another mode are re-sorted in memory rather than read again.
+    static bool GetCachedDirList(const std::string &path, DirList &entries) {
+        int sort = 0;
+        
+        if (!DirCache::Get(archive, path, entries, &sort))
+            return false;
+            
+        if (sort != cfg.sort) {
+            std::vector<u32> order;
+            FS::SortDirList(entries, order);
+            DirCache::Put(archive, path, cfg.sort, entries);
+        }
+        
+        return true;
+    }
+    
+    Result GetDirList(const std::string &path, DirList &entries) {
+        entries.Clear();
+            
+        // A synchronous re-read of the directory being streamed supersedes the background listing.
+        if ((dir_list_job.thread) && (dir_list_job.archive == archive) && (!dir_list_job.path.compare(path)))
+            FS::CancelDirList();
+            
+        if (FS::GetCachedDirList(path, entries))
+            return 0;
             
         Result ret = 0;
         Handle dir = 0;
-        std::u16string path_u16 = std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t>{}.from_bytes(path.data());
+        std::u16string path_u16 = Unicode::ToUTF16(path);
+        u64 start_time = osGetTime();
         
         if (R_FAILED(ret = FSUSER_OpenDirectory(&dir, archive, fsMakePath(PATH_UTF16, path_u16.c_str())))) {
             Log::Error("FSUSER_OpenDirectory(%s) failed: 0x%x\n", path.c_str(), ret);
             return ret;
         }
         
+        if (R_FAILED(ret = FS::ReadDirEntries(dir, entries))) {
+            Log::Error("FSDIR_Read(%s) failed: 0x%x\n", path.c_str(), ret);
+            FSDIR_Close(dir);
+            return ret;
+        }
+        
+        if (R_FAILED(ret = FSDIR_Close(dir))) {
+            Log::Error("FSDIR_Close(%s) failed: 0x%x\n", path.c_str(), ret);
+            return ret;
+        }
+        
+        u64 elapsed = osGetTime() - start_time;
+        Log::Debug("GetDirList(%s): %lu entries in %llu ms (%llu entries/sec)\n", path.c_str(), entries.Size(), elapsed, 
+            (static_cast<u64>(entries.Size()) * 1000) / (elapsed > 0? elapsed : 1));
+        
+        std::vector<u32> order;
+        FS::SortDirList(entries, order);
+        DirCache::Put(archive, path, cfg.sort, entries);
+        return 0;
+    }
+    
+    // Sorts an index array over precomputed keys, then moves each entry exactly once into its final place.
+    void SortDirList(DirList &entries, std::vector<u32> &order) {
+        std::vector<FSSortKey> keys;
+        std::vector<char16_t> pool;
+        FS::GetSortKeys(entries, keys, pool);
+        
+        order.resize(entries.Size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&keys, &pool](u32 a, u32 b) { return FS::Sort(pool.data(), keys[a], keys[b]); });
+        entries.Gather(order);
+    }
+    
+    static void DirListThread(void *args) {
+        FSDirListJob *job = static_cast<FSDirListJob *>(args);
+        std::vector<FS_DirectoryEntry> batch(dir_read_batch);
+        Result ret = 0;
         u32 entry_count = 0;
+        bool cancel = false;
         
         do {
-            FS_DirectoryEntry entry;
-            
-            if (R_FAILED(ret = FSDIR_Read(dir, &entry_count, 1, &entry))) {
-                Log::Error("FSDIR_Read(%s) failed: 0x%x\n", path.c_str(), ret);
-                return ret;
-            }
+            if (R_FAILED(ret = FSDIR_Read(job->dir, &entry_count, dir_read_batch, batch.data())))
+                break;
+                
+            LightLock_Lock(&job->lock);
+            for (u32 i = 0; i < entry_count; i++)
+                job->pending.Add(batch[i]);
+                
             
-            if (entry_count == 1)
-                entries.push_back(entry);
-        } while(entry_count > 0);
-        
-        std::sort(entries.begin(), entries.end(), FS::Sort);
+            if ((job->total == 0) && (entry_count > 0))
+                job->first_batch_time = osGetTime();
+                
+            job->total += entry_count;
+            cancel = job->cancel;
+            LightLock_Unlock(&job->lock);
+        } while((entry_count > 0) && (!cancel));
+        
+        LightLock_Lock(&job->lock);
+        job->result = ret;
+        job->finished = true;
+        LightLock_Unlock(&job->lock);
+    }
+    
+    static Result StartDirList(const std::string &path) {
+        Result ret = 0;
+        Handle dir = 0;
+        std::u16string path_u16 = Unicode::ToUTF16(path);
         
-        if (R_FAILED(ret = FSDIR_Close(dir))) {
-            Log::Error("FSDIR_Close(%s) failed: 0x%x\n", path.c_str(), ret);
+        // Open the directory here so a bad path fails the navigation right away, the worker only reads.
+        if (R_FAILED(ret = FSUSER_OpenDirectory(&dir, archive, fsMakePath(PATH_UTF16, path_u16.c_str())))) {
+            Log::Error("FSUSER_OpenDirectory(%s) failed: 0x%x\n", path.c_str(), ret);
             return ret;
         }
         
+        FS::CancelDirList();
+        
+        dir_list_job.dir = dir;
+        dir_list_job.archive = archive;
+        dir_list_job.path = path;
+        dir_list_job.pending.Clear();
+        dir_list_job.total = 0;
+        dir_list_job.start_time = osGetTime();
+        dir_list_job.first_batch_time = 0;
+        dir_list_job.result = 0;
+        dir_list_job.cancel = false;
+        dir_list_job.finished = false;
+        LightLock_Init(&dir_list_job.lock);
+        
+        // Run just below the UI thread so enumeration only soaks up the time the UI spends waiting for vblank.
+        s32 prio = 0;
+        svcGetThreadPriority(&prio, CUR_THREAD_HANDLE);
+        dir_list_job.thread = threadCreate(FS::DirListThread, &dir_list_job, 16 * 1024, prio + 1, -2, false);
+        
+        if (!dir_list_job.thread) {
+            Log::Error("threadCreate(DirListThread) failed\n");
+            FSDIR_Close(dir);
+            return -1;
+        }
+        
         return 0;
     }
     
-    static Result ChangeDir(const std::string &path, std::vector<FS_DirectoryEntry> &entries) {
+    DirListState PollDirList(DirList &entries, std::vector<u32> &order) {
+        if (!dir_list_job.thread)
+            return DirListIdle;
+            
+        LightLock_Lock(&dir_list_job.lock);
+        entries.Append(dir_list_job.pending);
+        dir_list_job.pending.Clear();
+        bool finished = dir_list_job.finished;
+        LightLock_Unlock(&dir_list_job.lock);
+        
+        if (!finished)
+            return DirListLoading;
+            
+        if (R_FAILED(dir_list_job.result))
+            Log::Error("FSDIR_Read(%s) failed: 0x%x\n", dir_list_job.path.c_str(), dir_list_job.result);
+            
+        u64 elapsed = osGetTime() - dir_list_job.start_time;
+        Log::Debug("PollDirList(%s): %lu entries in %llu ms, first batch after %llu ms (%llu entries/sec)\n", dir_list_job.path.c_str(), 
+            dir_list_job.total, elapsed, (dir_list_job.first_batch_time > 0)? dir_list_job.first_batch_time - dir_list_job.start_time : elapsed,
+            (static_cast<u64>(dir_list_job.total) * 1000) / (elapsed > 0? elapsed : 1));
+            
+        FS::SortDirList(entries, order);
+        
+        if (R_SUCCEEDED(dir_list_job.result))
+            DirCache::Put(dir_list_job.archive, dir_list_job.path, cfg.sort, entries);
+            
+        FS::CancelDirList();
+        return DirListDone;
+    }
+    
+    void CancelDirList(void) {
+        if (!dir_list_job.thread)
+            return;
+            
+        LightLock_Lock(&dir_list_job.lock);
+        dir_list_job.cancel = true;
+        LightLock_Unlock(&dir_list_job.lock);
+        
+        threadJoin(dir_list_job.thread, U64_MAX);
+        threadFree(dir_list_job.thread);
+        FSDIR_Close(dir_list_job.dir);
+        
+        dir_list_job.thread = nullptr;
+        dir_list_job.dir = 0;
+        dir_list_job.pending = DirList();
+    }
+    
+    Result ChangeDir(const std::string &path, DirList &entries) {
         Result ret = 0;
-        std::vector<FS_DirectoryEntry> new_entries;
+        DirList cached_entries;
         
-        if (R_FAILED(ret = FS::GetDirList(path, new_entries)))
+        if (FS::GetCachedDirList(path, cached_entries)) {
+            FS::CancelDirList();
+            std::swap(entries, cached_entries);
+        }
+        else if (R_FAILED(ret = FS::StartDirList(path)))
             return ret;
+        else
+            entries.Clear();
             
-        entries.clear();
         cfg.cwd = path;
 
         if (archive == sdmc_archive)
             Config::Save(cfg);
         
-        entries = new_entries;
         return 0;
     }
     
-    Result ChangeDirNext(const std::string &path, std::vector<FS_DirectoryEntry> &entries) {
+    Result ChangeDirNext(const std::string &path, DirList &entries) {
         std::string new_path = cfg.cwd;
         new_path.append(path);
         new_path.append("/");
         return FS::ChangeDir(new_path, entries);
     }
     
-    Result ChangeDirPrev(std::vector<FS_DirectoryEntry> &entries) {
+    Result ChangeDirPrev(DirList &entries) {
         std::filesystem::path path = (cfg.cwd.length() <= 1)? cfg.cwd : cfg.cwd.substr(0, cfg.cwd.size() - 1);
         std::string parent_path = path.parent_path();
         return FS::ChangeDir((parent_path.length() <= 1)? parent_path : parent_path.append("/"), entries);
     }
     
-    Result Delete(FS_DirectoryEntry *entry) {
+    // Applies an edit to the cached listing of path (if there is one) so the refresh that follows doesn't have to re-read it.
+    template<typename Func> static void PatchCachedDirList(const std::string &path, Func patch) {
+        DirList entries;
+        std::vector<u32> order;
+        int sort = 0;
+        
+        if (!DirCache::Take(archive, path, entries, &sort))
+            return;
+            
+        patch(entries);
+        FS::SortDirList(entries, order);
+        DirCache::Put(archive, path, cfg.sort, std::move(entries));
+    }
+    
+    Result Rename(const DirList &entries, u32 index, const std::string &filename) {
         Result ret = 0;
-        
-        std::u16string cwd = std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t>{}.from_bytes(cfg.cwd.data());
-        std::u16string path = cwd;
-        path.append(reinterpret_cast<const char16_t *>(entry->name));
-        
-        if (entry->attributes & FS_ATTRIBUTE_DIRECTORY) {
-            if (R_FAILED(ret = FSUSER_DeleteDirectoryRecursively(archive, fsMakePath(PATH_UTF16, path.c_str())))) {
-                Log::Error("FSUSER_DeleteDirectoryRecursively(%s) failed: 0x%x\n", path.c_str(), ret);
+        const char16_t *name = entries.GetName(index);
+        PathBuilder path(cfg.cwd), new_path(cfg.cwd);
+        path.Append(name);
+        new_path.Append(filename);
+        
+        if (entries.IsDir(index)) {
+            if (R_FAILED(ret = FSUSER_RenameDirectory(archive, path.GetPath(), archive, new_path.GetPath()))) {
+                Log::Error("FSUSER_RenameDirectory(%s, %s) failed: 0x%x\n", path.ToUTF8().c_str(), new_path.ToUTF8().c_str(), ret);
                 return ret;
             }
+            
+            DirCache::InvalidateTree(archive, path.ToUTF8() + "/");
         }
         else {
-            if (R_FAILED(ret = FSUSER_DeleteFile(archive, fsMakePath(PATH_UTF16, path.c_str())))) {
-                Log::Error("FSUSER_DeleteFile(%s) failed: 0x%x\n", path.c_str(), ret);
+            if (R_FAILED(ret = FSUSER_RenameFile(archive, path.GetPath(), archive, new_path.GetPath()))) {
+                Log::Error("FSUSER_RenameFile(%s, %s) failed: 0x%x\n", path.ToUTF8().c_str(), new_path.ToUTF8().c_str(), ret);
                 return ret;
             }
         }
         
+        FS::PatchCachedDirList(cfg.cwd, [name, &new_path](DirList &entries) {
+            int index = entries.Find(name);
+            if (index != -1)
+                entries.SetName(index, new_path.GetName());
+        });
+        
         return 0;
     }
     
-    Result Rename(FS_DirectoryEntry *entry, const std::string &filename) {
+    static void AddCachedEntry(const char16_t *name, u32 attributes) {
+        FS::PatchCachedDirList(cfg.cwd, [name, attributes](DirList &entries) {
+            if (entries.Find(name) == -1)
+                entries.Add(name, attributes, 0);
+        });
+    }
+    
+    Result MakeDir(const std::string &name) {
         Result ret = 0;
-        std::u16string cwd = std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t>{}.from_bytes(cfg.cwd.data());
-        std::u16string filename_u16 = std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t>{}.from_bytes(filename.data());
-        
-        std::u16string path = cwd;
-        path.append(reinterpret_cast<const char16_t *>(entry->name));
-        
-        std::u16string new_path = cwd;
-        new_path.append(filename_u16);
+        PathBuilder path(cfg.cwd);
+        path.Append(name);
         
-        if (entry->attributes & FS_ATTRIBUTE_DIRECTORY) {
-            if (R_FAILED(ret = FSUSER_RenameDirectory(archive, fsMakePath(PATH_UTF16, path.c_str()), archive, fsMakePath(PATH_UTF16, new_path.c_str())))) {
-                Log::Error("FSUSER_RenameDirectory(%s, %s) failed: 0x%x\n", path.c_str(), new_path.c_str(), ret);
-                return ret;
-            }
-        }
-        else {
-            if (R_FAILED(ret = FSUSER_RenameFile(archive, fsMakePath(PATH_UTF16, path.c_str()), archive, fsMakePath(PATH_UTF16, new_path.c_str())))) {
-                Log::Error("FSUSER_RenameFile(%s, %s) failed: 0x%x\n", path.c_str(), new_path.c_str(), ret);
-                return ret;
-            }
+        if (R_FAILED(ret = FSUSER_CreateDirectory(archive, path.GetPath(), 0))) {
+            Log::Error("FSUSER_CreateDirectory(%s) failed: 0x%x\n", name.c_str(), ret);
+            return ret;
         }
         
+        FS::AddCachedEntry(path.GetName(), FS_ATTRIBUTE_DIRECTORY);
         return 0;
     }
     
-    static Result CopyFile(const std::u16string &src_path, const std::u16string &dest_path) {
+    Result MakeFile(const std::string &name) {
         Result ret = 0;
-        Handle src_handle, dest_handle;
+        PathBuilder path(cfg.cwd);
+        path.Append(name);
         
-        if (R_FAILED(ret = FSUSER_OpenFile(&src_handle, src_archive, fsMakePath(PATH_UTF16, src_path.c_str()), FS_OPEN_READ, 0))) {
-            Log::Error("FSUSER_OpenFile(%s) failed: 0x%x\n", src_path.c_str(), ret);
+        if (R_FAILED(ret = FSUSER_CreateFile(archive, path.GetPath(), 0, 0))) {
+            Log::Error("FSUSER_CreateFile(%s) failed: 0x%x\n", name.c_str(), ret);
             return ret;
         }
         
-        u64 size = 0;
-        if (R_FAILED(ret = FSFILE_GetSize(src_handle, &size))) {
-            Log::Error("FSFILE_GetSize(%s) failed: 0x%x\n", src_path.c_str(), ret);
-            FSFILE_Close(src_handle);
-            return ret;
+        FS::AddCachedEntry(path.GetName(), 0);
+        return 0;
+    }
+    
+    // The tree operations below only touch the file system, background jobs run them and update the listing
+    // cache themselves once they finish.
+    static Result TransferTree(FS_Archive src_archive, const std::u16string &src, FS_Archive dest_archive, const std::u16string &dest, bool is_dir, 
+        bool move, ConflictPolicy policy) {
+        Result ret = 0;
+        PathBuilder src_path(src), dest_path(dest);
+        
+        // The whole tree is planned up front, conflicts with what the destination already has included, so a copy that
+        // can't fit is refused before anything is written. A resumed copy carries on with the manifest and plan from its
+        // journal, its space was checked when it first started.
+        TreeManifest manifest;
+        std::vector<u8> skip;
+        Progress::SetItem("Preparing...", 0);
+        
+        if (Journal::GetManifest(manifest)) {
+            for (u32 i = 0; i < manifest.Size(); i++)
+                skip.push_back(Journal::IsSkipped(i));
         }
-
-        // Make sure we have enough storage to carry out this operation
-        if (FS::GetFreeStorage(src_archive == sdmc_archive? SYSTEM_MEDIATYPE_SD : SYSTEM_MEDIATYPE_CTR_NAND) < size) {
-            Log::Error("Not enough storage is available to process this command 0x%x\n", src_path.c_str(), ret);
-            FSFILE_Close(src_handle);
-            return -1;
+        else {
+            if (R_FAILED(ret = TreeWalk::Build(src_archive, src_path, is_dir, manifest)))
+                return ret;
+                
+            if (Progress::IsCancelled())
+                return 0;
+                
+            if (R_FAILED(ret = Conflict::Plan(src_archive, src_path, dest_archive, dest_path, manifest, policy, skip)))
+                return ret;
+                
+            if (R_FAILED(ret = CopyPlan::CheckSpace(dest_archive, manifest, skip)))
+                return ret;
+                
+            Journal::SetManifest(manifest);
+            
+            for (u32 i = 0; i < manifest.Size(); i++) {
+                if (skip[i])
+                    Journal::Skip(i);
+            }
+            
+            Journal::Sync();
         }
         
-        // This may fail or not, but we don't care -> create the file if it doesn't exist, otherwise continue.
-        FSUSER_CreateFile(archive, fsMakePath(PATH_UTF16, dest_path.c_str()), 0, size);
+        Log::Debug("%s(%s): %lu files, %lu folders, %llu bytes, %lu files kept\n", move? "MoveTree" : "CopyTree", src_path.ToUTF8().c_str(), 
+            manifest.num_files, manifest.num_dirs, manifest.total_bytes, static_cast<u32>(std::count(skip.begin(), skip.end(), 1)));
+            
+        Progress::AddTotal(manifest.total_bytes, manifest.num_files);
+        if (is_dir)
+            CopyPlan::CreateDirs(dest_archive, dest_path, manifest);
+            
+        ret = CopyPlan::Run(src_archive, dest_archive, manifest, skip, src_path, dest_path, move);
         
-        if (R_FAILED(ret = FSUSER_OpenFile(&dest_handle, archive, fsMakePath(PATH_UTF16, dest_path.c_str()), FS_OPEN_WRITE, 0))) {
-            Log::Error("FSUSER_OpenFile(%s) failed: 0x%x\n", dest_path.c_str(), ret);
-            FSFILE_Close(src_handle);
-            return ret;
+        if ((move) && (is_dir))
+            CopyPlan::RemoveDirs(src_archive, src_path, manifest);
+            
+        // Folders that couldn't be read are reported once the rest of the tree has been copied.
+        if ((R_SUCCEEDED(ret)) && (manifest.errors > 0)) {
+            Log::Error("%s(%s): %lu folders couldn't be read\n", move? "MoveTree" : "CopyTree", src_path.ToUTF8().c_str(), manifest.errors);
+            ret = manifest.result;
         }
         
-        u32 bytes_read = 0, bytes_written = 0;
-        const u64 buf_size = 0x10000;
-        u64 offset = 0;
-        u8 *buf = new u8[buf_size];
-        std::string filename = std::filesystem::path(std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t>{}.to_bytes(src_path.data())).filename();
-        
-        do {
-            if (Utils::IsCancelButtonPressed()) {
-                FSFILE_SetSize(dest_handle, offset);
-                delete[] buf;
-                FSFILE_Close(src_handle);
-                FSFILE_Close(dest_handle);
-                return 0;
-            }
+        return ret;
+    }
+    
+    Result CopyTree(FS_Archive src_archive, const std::u16string &src, FS_Archive dest_archive, const std::u16string &dest, bool is_dir, 
+        ConflictPolicy policy) {
+        return FS::TransferTree(src_archive, src, dest_archive, dest, is_dir, false, policy);
+    }
+    
+    // Moves src into a dest that already exists within one archive, file by file so each conflict is settled by policy.
+    // Every file the destination doesn't keep is renamed into place, the source folders left empty are then removed.
+    static Result MergeTree(FS_Archive archive, PathBuilder &src_path, PathBuilder &dest_path, bool is_dir, ConflictPolicy policy) {
+        Result ret = 0, file_ret = 0;
+        TreeManifest manifest;
+        std::vector<u8> skip;
+        
+        if (R_FAILED(ret = TreeWalk::Build(archive, src_path, is_dir, manifest)))
+            return ret;
+            
+        if (R_FAILED(ret = Conflict::Plan(archive, src_path, archive, dest_path, manifest, policy, skip)))
+            return ret;
             
-            std::memset(buf, 0, buf_size);
+        Progress::AddTotal(0, manifest.num_files);
+        if (is_dir)
+            CopyPlan::CreateDirs(archive, dest_path, manifest);
             
-            if (R_FAILED(ret = FSFILE_Read(src_handle, &bytes_read, offset, buf, buf_size))) {
-                Log::Error("FSFILE_Read(%s) failed: 0x%x\n", src_path.c_str(), ret);
-                delete[] buf;
-                FSFILE_Close(src_handle);
-                FSFILE_Close(dest_handle);
-                return ret;
+        for (u32 i = 0; (i < manifest.Size()) && (!Progress::IsCancelled()); i++) {
+            if (manifest.IsDir(i))
+                continue;
+                
+            if (skip[i]) {
+                Progress::AddSkipped(1, 0);
+                continue;
             }
             
-            if (R_FAILED(ret = FSFILE_Write(dest_handle, &bytes_written, offset, buf, bytes_read, FS_WRITE_FLUSH))) {
-                Log::Error("FSFILE_Write(%s) failed: 0x%x\n", dest_path.c_str(), ret);
-                delete[] buf;
-                FSFILE_Close(src_handle);
-                FSFILE_Close(dest_handle);
-                return ret;
+            const char16_t *rel_path = manifest.GetPath(i);
+            u32 src_length = rel_path[0] != u'\0'? src_path.Append(rel_path) : src_path.Length();
+            u32 dest_length = rel_path[0] != u'\0'? dest_path.Append(rel_path) : dest_path.Length();
+            Progress::SetItem(Unicode::ToUTF8(src_path.GetName(), std::char_traits<char16_t>::length(src_path.GetName())), 0);
+            
+            FSUSER_DeleteFile(archive, dest_path.GetPath());
+            if (R_FAILED(file_ret = FSUSER_RenameFile(archive, src_path.GetPath(), archive, dest_path.GetPath()))) {
+                Log::Error("FSUSER_RenameFile(%s, %s) failed: 0x%x\n", src_path.ToUTF8().c_str(), dest_path.ToUTF8().c_str(), file_ret);
+                
+                if (R_SUCCEEDED(ret))
+                    ret = file_ret;
             }
             
-            offset += bytes_read;
-            GUI::ProgressBar("Copying", filename.c_str(), offset, size);
-        } while(offset < size);
+            Progress::ItemDone(file_ret);
+            src_path.Truncate(src_length);
+            dest_path.Truncate(dest_length);
+        }
         
-        delete[] buf;
-        FSFILE_Close(src_handle);
-        FSFILE_Close(dest_handle);
-        return 0;
+        if (is_dir)
+            CopyPlan::RemoveDirs(archive, src_path, manifest);
+            
+        return ret;
     }
     
-    static Result CopyDir(const std::u16string &src_path, const std::u16string &dest_path) {
+    // A rename can't cross archives, so a move between SD and CTRNAND is a copy that deletes each source file once its
+    // copy is complete. Within one archive the rename is kept, it's instant whatever the size, unless something is
+    // already in the way.
+    Result MoveTree(FS_Archive src_archive, const std::u16string &src, FS_Archive dest_archive, const std::u16string &dest, bool is_dir, 
+        ConflictPolicy policy) {
+        if (src_archive != dest_archive)
+            return FS::TransferTree(src_archive, src, dest_archive, dest, is_dir, true, policy);
+            
         Result ret = 0;
-        Handle dir;
+        PathBuilder src_path(src), dest_path(dest);
+        std::string dest_name = dest_path.ToUTF8();
         
-        if (R_FAILED(ret = FSUSER_OpenDirectory(&dir, src_archive, fsMakePath(PATH_UTF16, src_path.c_str())))) {
-            Log::Error("FSUSER_OpenDirectory(%s) failed: 0x%x\n", src_path, ret);
-            return ret;
-        }
-        
-        // This may fail or not, but we don't care -> make the dir if it doesn't exist, otherwise continue.
-        FSUSER_CreateDirectory(archive, fsMakePath(PATH_UTF16, dest_path.c_str()), 0);
+        if ((FS::FileExists(dest_archive, dest_name)) || (FS::DirExists(dest_archive, dest_name)))
+            return FS::MergeTree(src_archive, src_path, dest_path, is_dir, policy);
         
-        u32 entry_count = 0;
-        
-        do {
-            FS_DirectoryEntry entry;
-            
-            if (R_FAILED(ret = FSDIR_Read(dir, &entry_count, 1, &entry))) {
-                Log::Error("FSDIR_Read(%s) failed: 0x%x\n", src_path.c_str(), ret);
+        if (is_dir) {
+            if (R_FAILED(ret = FSUSER_RenameDirectory(src_archive, src_path.GetPath(), dest_archive, dest_path.GetPath()))) {
+                Log::Error("FSUSER_RenameDirectory(%s, %s) failed: 0x%x\n", src_path.ToUTF8().c_str(), dest_path.ToUTF8().c_str(), ret);
                 return ret;
             }
-            
-            if (entry_count == 1) {
-                std::u16string src = src_path;
-                src.append(u"/");
-                src.append(reinterpret_cast<const char16_t *>(entry.name));
-                
-                std::u16string dest = dest_path;
-                dest.append(u"/");
-                dest.append(reinterpret_cast<const char16_t *>(entry.name));
-                
-                if (entry.attributes & FS_ATTRIBUTE_DIRECTORY)
-                    FS::CopyDir(src, dest); // Copy Folder (via recursion)
-                else
-                    FS::CopyFile(src, dest); // Copy File
+        }
+        else {
+            if (R_FAILED(ret = FSUSER_RenameFile(src_archive, src_path.GetPath(), dest_archive, dest_path.GetPath()))) {
+                Log::Error("FSUSER_RenameFile(%s, %s) failed: 0x%x\n", src_path.ToUTF8().c_str(), dest_path.ToUTF8().c_str(), ret);
+                return ret;
             }
-        } while(entry_count > 0);
-        
-        if (R_FAILED(ret = FSDIR_Close(dir))) {
-            Log::Error("FSDIR_Close(%s) failed: 0x%x\n", src_path.c_str(), ret);
-            return ret;
         }
         
         return 0;
     }
-
-    static void ClearFSCopyEntry(void) {
-        fs_copy_entry.copy_path.clear();
-        fs_copy_entry.copy_filename.clear();
-        fs_copy_entry.is_dir = false;
-    }
     
-    void Copy(FS_DirectoryEntry *entry, const std::string &path) {
-        FS::ClearFSCopyEntry();
-        fs_copy_entry.copy_path = std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t>{}.from_bytes(path.data());
-        fs_copy_entry.copy_path.append(reinterpret_cast<const char16_t *>(entry->name));
-        fs_copy_entry.copy_filename.append(reinterpret_cast<const char16_t *>(entry->name));
-        
-        if (entry->attributes & FS_ATTRIBUTE_DIRECTORY)
-            fs_copy_entry.is_dir = true;
-            
-        src_archive = archive;
-    }
-    
-    Result Paste(void) {
+    static Result DeleteEntry(FS_Archive archive, const PathBuilder &path, bool is_dir) {
         Result ret = 0;
-        std::u16string path = std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t>{}.from_bytes(cfg.cwd.data());
-        path.append(fs_copy_entry.copy_filename);
         
-        if (fs_copy_entry.is_dir) // Copy folder recursively
-            ret = FS::CopyDir(fs_copy_entry.copy_path, path);
-        else // Copy file
-            ret = FS::CopyFile(fs_copy_entry.copy_path, path);
-            
-        FS::ClearFSCopyEntry();
+        if (is_dir) {
+            if (R_FAILED(ret = FSUSER_DeleteDirectory(archive, path.GetPath())))
+                Log::Error("FSUSER_DeleteDirectory(%s) failed: 0x%x\n", path.ToUTF8().c_str(), ret);
+        }
+        else {
+            if (R_FAILED(ret = FSUSER_DeleteFile(archive, path.GetPath())))
+                Log::Error("FSUSER_DeleteFile(%s) failed: 0x%x\n", path.ToUTF8().c_str(), ret);
+        }
+        
         return ret;
     }
     
-    Result Move(void) {
-        Result ret = 0;
-        std::u16string path = std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t>{}.from_bytes(cfg.cwd.data());
-        path.append(fs_copy_entry.copy_filename);
-        
-        if (fs_copy_entry.is_dir) {
-            if (R_FAILED(ret = FSUSER_RenameDirectory(src_archive, fsMakePath(PATH_UTF16, fs_copy_entry.copy_path.c_str()), archive, fsMakePath(PATH_UTF16, path.c_str())))) {
-                Log::Error("FSUSER_RenameDirectory(%s, %s) failed: 0x%x\n", path.c_str(), fs_copy_entry.copy_filename.c_str(), ret);
-                return ret;
+    // The tree is listed first and then removed one entry at a time, contents before their folder, so progress can be
+    // shown per entry and a cancel always stops between two whole deletes. An entry that can't be removed doesn't stop
+    // the rest, its folders are then left in place since they aren't empty.
+    Result DeleteTree(FS_Archive archive, const std::u16string &path, bool is_dir) {
+        Result ret = 0, entry_ret = 0;
+        PathBuilder delete_path(path);
+        TreeManifest manifest;
+        
+        Progress::SetItem("Preparing...", 0);
+        if (R_FAILED(ret = TreeWalk::Build(archive, delete_path, is_dir, manifest)))
+            return ret;
+            
+        u32 total = manifest.Size() + (is_dir? 1 : 0);
+        u32 files = 0, dirs = 0, kept = 0;
+        Progress::AddTotal(0, total);
+        
+        for (u32 i = manifest.Size(); (i-- > 0) && (!Progress::IsCancelled());) {
+            const char16_t *rel_path = manifest.GetPath(i);
+            u32 length = rel_path[0] != u'\0'? delete_path.Append(rel_path) : delete_path.Length();
+            Progress::SetItem(Unicode::ToUTF8(delete_path.GetName(), std::char_traits<char16_t>::length(delete_path.GetName())), 0);
+            
+            if (R_FAILED(entry_ret = FS::DeleteEntry(archive, delete_path, manifest.IsDir(i)))) {
+                if (R_SUCCEEDED(ret))
+                    ret = entry_ret;
+                    
+                kept++;
             }
+            else if (manifest.IsDir(i))
+                dirs++;
+            else
+                files++;
+                
+            Progress::ItemDone(entry_ret);
+            delete_path.Truncate(length);
         }
-        else {
-            if (R_FAILED(ret = FSUSER_RenameFile(src_archive, fsMakePath(PATH_UTF16, fs_copy_entry.copy_path.c_str()), archive, fsMakePath(PATH_UTF16, path.c_str())))) {
-                Log::Error("FSUSER_RenameFile(%s, %s) failed: 0x%x\n", path.c_str(), fs_copy_entry.copy_filename.c_str(), ret);
-                return ret;
+        
+        if ((is_dir) && (!Progress::IsCancelled())) {
+            if (R_FAILED(entry_ret = FS::DeleteEntry(archive, delete_path, true))) {
+                if (R_SUCCEEDED(ret))
+                    ret = entry_ret;
+                    
+                kept++;
             }
+            else
+                dirs++;
+                
+            Progress::ItemDone(entry_ret);
         }
         
-        FS::ClearFSCopyEntry();
-        return 0;
+        u32 skipped = total - (files + dirs + kept);
+        Log::Debug("DeleteTree(%s): removed %lu files and %lu folders, %lu failed, %lu not reached%s\n", delete_path.ToUTF8().c_str(), files, dirs, 
+            kept, skipped, Progress::IsCancelled()? " (cancelled)" : "");
+            
+        // Folders that couldn't be listed still hold whatever was in them.
+        if ((R_SUCCEEDED(ret)) && (manifest.errors > 0)) {
+            Log::Error("DeleteTree(%s): %lu folders couldn't be read\n", delete_path.ToUTF8().c_str(), manifest.errors);
+            ret = manifest.result;
+        }
+        
+        return ret;
     }
 }
@@ -3,39 +3,44 @@
 #include "config.h"
 #include "fs.h"
 #include "gui.h"
-#include "log.h"
+#include "jobs.h"
+#include "trash.h"
 #include "textures.h"
 #include "touch.h"
+#include "unicode.h"
 #include "utils.h"
 
 namespace Options {
+    // Every checked entry (or the selected one) is deleted by one background job, or moved to the trash when it's enabled.
+    // Whatever is already in the trash, or holds the trash itself, is deleted for good.
     void Delete(MenuItem *item, int *selection) {
-        Result ret = 0;
-        Log::Close();
+        Job job;
+        job.type = ((cfg.use_trash) && (!Trash::Contains(cfg.cwd)))? JobTrash : JobDelete;
+        job.src_archive = archive;
+        job.src_dir = cfg.cwd;
+        job.dest_archive = archive;
+        job.dest_dir = Trash::GetDir();
         
         if ((item->checked_count > 1) && (!item->checked_cwd.compare(cfg.cwd))) {
             for (u32 i = 0; i < item->checked.size(); i++) {
-                if (item->checked.at(i)) {
-                    if (R_FAILED(ret = FS::Delete(&item->entries[i]))) {
-                        FS::GetDirList(cfg.cwd, item->entries);
-                        GUI::ResetCheckbox(item);
-                        break;
-                    }
-                }
+                if (item->checked.at(i))
+                    job.AddItem(item->entries.GetName(i), item->entries.IsDir(i));
             }
         }
         else
-            ret = FS::Delete(&item->entries[item->selected]);
-        
-        if (R_SUCCEEDED(ret)) {
-            FS::GetDirList(cfg.cwd, item->entries);
-            GUI::ResetCheckbox(item);
+            job.AddItem(item->entries.GetName(item->selected), item->entries.IsDir(item->selected));
+            
+        if (job.type == JobTrash) {
+            for (u32 i = 0; i < job.names.size(); i++) {
+                std::string path = cfg.cwd + Unicode::ToUTF8(job.names[i]) + "/";
+                if ((job.dirs[i]) && (!Trash::GetDir().compare(0, path.length(), path)))
+                    job.type = JobDelete;
+            }
         }
         
-        GUI::RecalcStorageSize(item);
-        Log::Open();
+        Jobs::Add(job);
+        GUI::ResetCheckbox(item);
         *selection = 0;
-        item->selected = 0;
         item->state = MENU_STATE_FILEBROWSER;
     }
 }
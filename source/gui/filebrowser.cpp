@@ -1,26 +1,76 @@
 #include <algorithm>
-#include <codecvt>
-#include <locale>
 
-#include "archive_helper.h"
 #include "c2d_helper.h"
 #include "colours.h"
 #include "config.h"
+#include "dir_cache.h"
 #include "fs.h"
 #include "gui.h"
+#include "jobs.h"
+#include "list_view.h"
 #include "textures.h"
 #include "utils.h"
 
 namespace GUI {
-    static const int sel_dist = 20;
-    static const int start_y = 40;
-    static const u32 max_entries = 10;
-    static int start = 0;
+    static ListView list_view = { 0.f, 40.f, 400.f, 20.f, 10, 0 };
     static u64 timestamp = 0;
+    static bool loading = false;
 
     static std::string empty_dir = "This is an empty directory";
     static float empty_dir_width = 0.f, empty_dir_height = 0.f;
 
+    // Carries the checkboxes and cursor over to the entries' rows in a new sort order.
+    static void RemapDirList(MenuItem *item, const std::vector<u32> &order) {
+        std::vector<bool> checked(order.size());
+        item->checked.resize(order.size());
+        int row = item->selected - list_view.start, selected = 0;
+
+        for (u32 i = 0; i < order.size(); i++) {
+            checked[i] = item->checked[order[i]];
+
+            if (order[i] == static_cast<u32>(item->selected))
+                selected = i;
+        }
+
+        item->checked.swap(checked);
+        item->selected = selected;
+
+        // Keep the cursor on the same screen row if the list allows it.
+        list_view.start = item->selected - row;
+        GUI::ScrollListView(&list_view, item->selected, item->entries.Size());
+    }
+
+    void UpdateDirList(MenuItem *item) {
+        std::vector<u32> order;
+
+        switch (FS::PollDirList(item->entries, order)) {
+            case DirListLoading:
+                loading = true;
+                item->checked.resize(item->entries.Size());
+                break;
+
+            case DirListDone:
+                GUI::RemapDirList(item, order);
+                loading = false;
+                break;
+
+            default:
+                loading = false;
+                break;
+        }
+    }
+
+    void SortDirList(MenuItem *item) {
+        // A listing still streaming in is sorted with the current mode once it completes.
+        if (loading)
+            return;
+
+        std::vector<u32> order;
+        FS::SortDirList(item->entries, order);
+        GUI::RemapDirList(item, order);
+        DirCache::Put(archive, cfg.cwd, cfg.sort, item->entries);
+    }
+
     void DisplayFileBrowser(MenuItem *item) {
         float filename_height = 0.f;
         C2D::GetTextSize(0.45f, nullptr, &filename_height, cfg.cwd.c_str());
@@ -31,36 +81,45 @@ namespace GUI {
         float fill = (static_cast<double>(item->used_storage)/static_cast<double>(item->total_storage)) * 390.f;
         C2D::Rect(5, 28 + ((25 - filename_height) / 2), fill, 2, cfg.dark_theme? TITLE_COLOUR_DARK : TITLE_COLOUR);
 
-        if (item->entries.empty()) {
+        if (loading) {
+            float loading_width = 0.f;
+            C2D::GetTextSize(0.45f, &loading_width, nullptr, "Loading 0000000...");
+            C2D::Textf(395 - loading_width, 15 + ((25 - filename_height) / 2), 0.45f, WHITE, "Loading %lu...", item->entries.Size());
+        }
+        else if (cfg.dev_options) {
+            u32 hits = 0, misses = 0;
+            DirCache::GetStats(&hits, &misses);
+
+            float stats_width = 0.f;
+            C2D::GetTextSize(0.45f, &stats_width, nullptr, "Cache 0000/0000");
+            C2D::Textf(395 - stats_width, 15 + ((25 - filename_height) / 2), 0.45f, WHITE, "Cache %lu/%lu", hits, misses);
+        }
+
+        if ((!loading) && (item->entries.Empty())) {
             C2D::GetTextSize(0.5f, &empty_dir_width, &empty_dir_height, empty_dir.c_str());
             C2D::Text(((400 - empty_dir_width) / 2), ((240 - empty_dir_height) / 2), 0.5f, cfg.dark_theme? WHITE : BLACK, empty_dir.c_str());
         }
 
-        for (u32 i = start; i < item->entries.size(); i++) {
-            const std::u16string entry_name_utf16 = reinterpret_cast<const char16_t *>(item->entries[i].name);
-            const std::string filename = std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t>{}.to_bytes(entry_name_utf16.data());
-
-            if (i == static_cast<u32>(item->selected))
-                C2D::Rect(0, start_y + (sel_dist * (i - start)), 400, sel_dist, cfg.dark_theme? SELECTOR_COLOUR_DARK : SELECTOR_COLOUR_LIGHT);
+        GUI::DrawListView(&list_view, item->entries.Size(), [item, filename_height](int i, float y) {
+            if (i == item->selected)
+                C2D::Rect(0, y, 400, list_view.row_height, cfg.dark_theme? SELECTOR_COLOUR_DARK : SELECTOR_COLOUR_LIGHT);
 
             if ((item->checked.at(i)) && (!item->checked_cwd.compare(cfg.cwd)))
-                C2D::Image(cfg.dark_theme? icon_check_dark : icon_check, 0, start_y + (sel_dist * (i - start)));
+                C2D::Image(cfg.dark_theme? icon_check_dark : icon_check, 0, y);
             else
-                C2D::Image(cfg.dark_theme? icon_uncheck_dark : icon_uncheck, 0, start_y + (sel_dist * (i - start)));
+                C2D::Image(cfg.dark_theme? icon_uncheck_dark : icon_uncheck, 0, y);
 
-            FileType file_type = FS::GetFileType(filename);
-            if (item->entries[i].attributes & FS_ATTRIBUTE_DIRECTORY)
-                C2D::Image(cfg.dark_theme? icon_dir_dark : icon_dir, 20, start_y + (sel_dist * (i - start)));
+            if (item->entries.IsDir(i))
+                C2D::Image(cfg.dark_theme? icon_dir_dark : icon_dir, 20, y);
             else
-                C2D::Image(file_icons[file_type], 20, start_y + (sel_dist * (i - start)));
+                C2D::Image(file_icons[item->entries.GetType(i)], 20, y);
 
-            C2D::Textf(45, start_y + ((sel_dist - filename_height) / 2) + (i - start) * sel_dist, 0.45f, cfg.dark_theme? WHITE : BLACK,
-                filename.length() > 52? "%.52s..." : "%s", filename.c_str());
-        }
+            C2D::Text(45, y + ((list_view.row_height - filename_height) / 2), 0.45f, cfg.dark_theme? WHITE : BLACK, item->entries.GetLabel(i));
+        });
     }
 
     void ControlFileBrowser(MenuItem *item, u32 *kDown, u32 *kHeld) {
-        u32 size = (item->entries.size() - 1);
+        u32 size = (item->entries.Size() - 1);
         Utils::SetBounds(&item->selected, 0, size);
 
         if ((*kDown & KEY_UP) || ((*kHeld & KEY_UP) && osGetTime() >= timestamp)) {
@@ -68,13 +127,6 @@ namespace GUI {
             if (item->selected < 0)
                 item->selected = size;
 
-            if (size < max_entries)
-                start = 0;
-            else if (start > item->selected)
-                start--;
-            else if ((static_cast<u32>(item->selected) == size) && (size > (max_entries - 1)))
-                start = size - (max_entries - 1);
-
             timestamp = osGetTime() + ((*kDown & KEY_UP) ? 500 : 100);
         }
         else if ((*kDown & KEY_DOWN) || ((*kHeld & KEY_DOWN) && osGetTime() >= timestamp)) {
@@ -82,59 +134,51 @@ namespace GUI {
             if(static_cast<u32>(item->selected) > size)
                 item->selected = 0;
 
-            if ((static_cast<u32>(item->selected) > (start + (max_entries - 1))) && ((start + (max_entries - 1)) < size))
-                start++;
-            if (item->selected == 0)
-                start = 0;
-
             timestamp = osGetTime() + ((*kDown & KEY_DOWN) ? 500 : 100);
         }
 
-        if (*kDown & KEY_DLEFT) {
+        if (*kDown & KEY_DLEFT)
             item->selected = 0;
-            start = 0;
-        }
-        else if (*kDown & KEY_DRIGHT) {
-            item->selected = item->entries.size() - 1;
-            if ((item->entries.size() - 1) > max_entries)
-                start = size - (max_entries - 1);
-        }
+        else if (*kDown & KEY_DRIGHT)
+            item->selected = size;
+
+        GUI::ScrollListView(&list_view, item->selected, item->entries.Size());
 
         if (*kDown & KEY_A) {
-            const std::u16string entry_name_utf16 = reinterpret_cast<const char16_t *>(item->entries[item->selected].name);
-            const std::string filename = std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t>{}.to_bytes(entry_name_utf16.data());
-
-            if (item->entries[item->selected].attributes & FS_ATTRIBUTE_DIRECTORY) {
-                if (item->entries.size() != 0) {
-                    if (R_SUCCEEDED(FS::ChangeDirNext(filename, item->entries))) {
-                        start = 0;
-                        // Make a copy before resizing our vector.
-                        if ((item->checked_count > 1) && (item->checked_copy.empty()))
-                            item->checked_copy = item->checked;
-                        
-                        item->checked.resize(item->entries.size());
-                        item->selected = 0;
-                    }
+            // An empty listing has nothing selected to open.
+            if (item->entries.Empty())
+                return;
+
+            const std::string filename = item->entries.GetUTF8Name(item->selected);
+
+            if (item->entries.IsDir(item->selected)) {
+                if (R_SUCCEEDED(FS::ChangeDirNext(filename, item->entries))) {
+                    list_view.start = 0;
+                    item->checked.resize(item->entries.Size());
+                    item->selected = 0;
                 }
             }
             else {
                 std::string path = cfg.cwd;
                 path.append(filename);
-                FileType file_type = FS::GetFileType(filename);
-                
-                switch(file_type) {
+                switch(item->entries.GetType(item->selected)) {
                     case FileTypeImage:
                         if (Textures::LoadImageFile(path, &item->texture))
                             item->state = MENU_STATE_IMAGEVIEWER;
                         break;
 
-                    case FileTypeZip:
-                        if (R_SUCCEEDED(ArchiveHelper::Extract(path))) {
-                            FS::GetDirList(cfg.cwd, item->entries);
-                            GUI::ResetCheckbox(item);
-                        }
-
+                    case FileTypeZip: {
+                        Job job;
+                        job.type = JobExtract;
+                        job.src_archive = archive;
+                        job.src_dir = cfg.cwd;
+                        job.dest_archive = archive;
+                        job.dest_dir = cfg.cwd;
+                        job.conflict = static_cast<ConflictPolicy>(cfg.conflict_policy);
+                        job.AddItem(item->entries.GetName(item->selected), false);
+                        Jobs::Add(job);
                         break;
+                    }
                     
                     default:
                         break;
@@ -143,16 +187,15 @@ namespace GUI {
         }
         else if (*kDown & KEY_B) {
             if (R_SUCCEEDED(FS::ChangeDirPrev(item->entries))) {
-                // Make a copy before resizing our vector.
-                if (item->checked_count > 1)
-                    item->checked_copy = item->checked;
-                    
-                item->checked.resize(item->entries.size());
+                item->checked.resize(item->entries.Size());
                 item->selected = 0;
-                start = 0;
+                list_view.start = 0;
             }
         }
         else if (*kDown & KEY_Y) {
+            if (item->entries.Empty())
+                return;
+
             if ((!item->checked_cwd.empty()) && (item->checked_cwd.compare(cfg.cwd) != 0))
                 GUI::ResetCheckbox(item);
                 
@@ -162,5 +205,7 @@ namespace GUI {
         }
         else if (*kDown & KEY_X)
             item->state = MENU_STATE_OPTIONS;
+        else if (*kDown & KEY_SELECT)
+            item->state = MENU_STATE_JOBS;
     }
 }
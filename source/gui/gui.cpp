@@ -5,6 +5,7 @@
 #include "config.h"
 #include "fs.h"
 #include "gui.h"
+#include "jobs.h"
 #include "net.h"
 #include "osk.h"
 #include "textures.h"
@@ -16,8 +17,7 @@ jmp_buf exit_jmp;
 namespace GUI {
     void ResetCheckbox(MenuItem *item) {
         item->checked.clear();
-        item->checked_copy.clear();
-        item->checked.resize(item->entries.size());
+        item->checked.resize(item->entries.Size());
         item->checked.assign(item->checked.size(), false);
         item->checked_cwd.clear();
         item->checked_count = 0;
@@ -28,7 +28,7 @@ namespace GUI {
         item->used_storage = FS::GetUsedStorage(archive == sdmc_archive? SYSTEM_MEDIATYPE_SD : SYSTEM_MEDIATYPE_CTR_NAND);
     }
 
-    void ProgressBar(const std::string &title, std::string message, u64 offset, u64 size) {
+    void ProgressBar(const std::string &title, std::string message, u64 offset, u64 size, const std::string &status) {
         if (message.length() > 35) {
             message.resize(35);
             message.append("...");
@@ -47,9 +47,14 @@ namespace GUI {
         C2D::Text(((320 - (text_width)) / 2), ((240 - (dialog.subtex->height)) / 2) + 40 - 3, 0.42f, cfg.dark_theme? TEXT_MIN_COLOUR_DARK : TEXT_MIN_COLOUR_LIGHT, message.c_str());
 
         C2D::Rect(((320 - (dialog.subtex->width)) / 2) + 20, ((240 - (dialog.subtex->height)) / 2) + 65, 240, 4, cfg.dark_theme? SELECTOR_COLOUR_DARK : SELECTOR_COLOUR_LIGHT);
-        C2D::Rect(((320 - (dialog.subtex->width)) / 2) + 20, ((240 - (dialog.subtex->height)) / 2) + 65, static_cast<int>((static_cast<float>(offset) / static_cast<float>(size)) * 240.f), 
+        C2D::Rect(((320 - (dialog.subtex->width)) / 2) + 20, ((240 - (dialog.subtex->height)) / 2) + 65, (size > 0)? static_cast<int>((static_cast<float>(offset) / static_cast<float>(size)) * 240.f) : 0, 
             4, cfg.dark_theme? TITLE_COLOUR_DARK : TITLE_COLOUR);
 
+        if (!status.empty()) {
+            C2D::GetTextSize(0.42f, &text_width, nullptr, status.c_str());
+            C2D::Text(((320 - (text_width)) / 2), ((240 - (dialog.subtex->height)) / 2) + 75, 0.42f, cfg.dark_theme? TEXT_MIN_COLOUR_DARK : TEXT_MIN_COLOUR_LIGHT, status.c_str());
+        }
+
         C2D::Render();
     }
 
@@ -57,7 +62,7 @@ namespace GUI {
         while(download_progress) {
             download_size = (download_size < 1.0f)? 1.0f : download_size;
             download_size = (download_size < download_offset)? download_offset : download_size;
-            GUI::ProgressBar("Downloading", envIsHomebrew()? "3DShell.3dsx" : "3DShell.cia", download_offset, download_size);
+            GUI::ProgressBar("Downloading", envIsHomebrew()? "3DShell.3dsx" : "3DShell.cia", download_offset, download_size, std::string());
         }
     }
 
@@ -94,6 +99,7 @@ namespace GUI {
             icon_options_overlay : (cfg.dark_theme? icon_options_dark : icon_options), 25, 0);
         C2D::Image((item->state == MENU_STATE_SETTINGS)? icon_settings_overlay : (cfg.dark_theme? icon_settings_dark : icon_settings), 50, 0);
         //C2D::Image(item->state == MENU_STATE_FTP? icon_ftp_overlay : (cfg.dark_theme? icon_ftp_dark : icon_ftp), 75, 0);
+        C2D::Textf(78, 3, 0.42f, item->state == MENU_STATE_JOBS? TITLE_COLOUR_DARK : WHITE, "Jobs (%lu)", Jobs::GetActiveCount());
         C2D::Image(archive == sdmc_archive? icon_sd_overlay : (cfg.dark_theme? icon_sd_dark : icon_sd), 250, 0);
         C2D::Image(archive == nand_archive? icon_secure_overlay : (cfg.dark_theme? icon_secure_dark : icon_secure), 275, 0);
         C2D::Image(icon_search, 300, 0);
@@ -106,12 +112,13 @@ namespace GUI {
             item->state = MENU_STATE_OPTIONS;
         else if ((*kDown & KEY_TOUCH) && (Touch::Rect(48, 0, 72, 20)))
             item->state = MENU_STATE_SETTINGS;
+        else if ((*kDown & KEY_TOUCH) && (Touch::Rect(73, 0, 140, 20)))
+            item->state = MENU_STATE_JOBS;
         else if ((*kDown & KEY_TOUCH) && (Touch::Rect(247, 0, 272, 20))) {
             if (archive != sdmc_archive) {
                 archive = sdmc_archive;
-                cfg.cwd = "/";
                 item->selected = 0;
-                FS::GetDirList(cfg.cwd, item->entries);
+                FS::ChangeDir("/", item->entries);
                 GUI::ResetCheckbox(item);
                 GUI::RecalcStorageSize(item);
             }
@@ -119,9 +126,8 @@ namespace GUI {
         else if ((*kDown & KEY_TOUCH) && (Touch::Rect(273, 0, 292, 20))) {
             if ((archive != nand_archive) && (cfg.dev_options)) {
                 archive = nand_archive;
-                cfg.cwd = "/";
                 item->selected = 0;
-                FS::GetDirList(cfg.cwd, item->entries);
+                FS::ChangeDir("/", item->entries);
                 GUI::ResetCheckbox(item);
                 GUI::RecalcStorageSize(item);
             }
@@ -129,10 +135,8 @@ namespace GUI {
         else if ((*kDown & KEY_TOUCH) && (Touch::Rect(293, 0, 320, 20))) {
             std::string path = OSK::GetText("/", "Enter file path");
             path.append((path.back() != '/')? "/" : "");
-            if (FS::DirExists(archive, path)) {
-                cfg.cwd = path;
+            if (R_SUCCEEDED(FS::ChangeDir(path, item->entries))) {
                 item->selected = 0;
-                FS::GetDirList(cfg.cwd, item->entries);
                 GUI::ResetCheckbox(item);
                 GUI::RecalcStorageSize(item);
             }
@@ -146,11 +150,12 @@ namespace GUI {
         item.state = MENU_STATE_FILEBROWSER;
         item.selected = 0;
 
-		if (R_FAILED(ret = FS::GetDirList(cfg.cwd, item.entries)))
+		if (R_FAILED(ret = FS::ChangeDir(cfg.cwd, item.entries)))
 			return ret;
             
         GUI::ResetCheckbox(&item);
         GUI::RecalcStorageSize(&item);
+        GUI::CheckInterrupted(&item);
 
         u64 last_time = osGetTime(), current_time = 0;
 
@@ -159,6 +164,15 @@ namespace GUI {
             u64 delta_time = current_time - last_time;
             last_time = current_time;
 
+            GUI::UpdateDirList(&item);
+
+            // A finished job may have changed the folder on screen
+            if (Jobs::Update(archive, cfg.cwd)) {
+                FS::GetDirList(cfg.cwd, item.entries);
+                GUI::ResetCheckbox(&item);
+                GUI::RecalcStorageSize(&item);
+            }
+
             C3D_FrameBegin(C3D_FRAME_SYNCDRAW);
             C2D_TargetClear(top_screen, cfg.dark_theme? BLACK_BG : WHITE);
             C2D_TargetClear(bottom_screen, cfg.dark_theme? MENU_BAR_DARK : STATUS_BAR_LIGHT);
@@ -198,6 +212,18 @@ namespace GUI {
                     DisplayImageViewerBottom(&item);
                     break;
 
+                case MENU_STATE_JOBS:
+                    GUI::DisplayJobs(&item);
+                    break;
+
+                case MENU_STATE_RESUME:
+                    GUI::DisplayResume(&item);
+                    break;
+
+                case MENU_STATE_TRASH:
+                    GUI::DisplayTrash(&item);
+                    break;
+
                 default:
                     break;
             }
@@ -234,6 +260,18 @@ namespace GUI {
                     GUI::ControlImageViewer(&item, &kDown, &kHeld, &delta_time);
                     break;
 
+                case MENU_STATE_JOBS:
+                    GUI::ControlJobs(&item, &kDown);
+                    break;
+
+                case MENU_STATE_RESUME:
+                    GUI::ControlResume(&item, &kDown);
+                    break;
+
+                case MENU_STATE_TRASH:
+                    GUI::ControlTrash(&item, &kDown);
+                    break;
+
                 default:
                     break;
             }
@@ -244,7 +282,8 @@ namespace GUI {
                 break;
         }
 
-        item.entries.clear();
+        FS::CancelDirList();
+        item.entries.Clear();
         return 0;
     }
 }
@@ -0,0 +1,240 @@
+#include "c2d_helper.h"
+#include "colours.h"
+#include "config.h"
+#include "gui.h"
+#include "jobs.h"
+#include "journal.h"
+#include "list_view.h"
+#include "textures.h"
+#include "touch.h"
+#include "utils.h"
+
+namespace GUI {
+    static ListView jobs_view = { 0.f, 55.f, 320.f, 46.f, 4, 0 };
+    static std::vector<Job> jobs;
+    static int selection = 0;
+    static Job interrupted;
+    static std::string interrupted_title;
+    static float cancel_height = 0.f, cancel_width = 0.f, confirm_height = 0.f, confirm_width = 0.f;
+    
+    static const char *GetStateName(const Job &job) {
+        switch (job.state) {
+            case JobQueued:
+                return job.held? "Held" : "Queued";
+            case JobRunning:
+                return "Running";
+            case JobPaused:
+                return "Paused";
+            case JobDone:
+                return "Done";
+            case JobFailed:
+                return "Failed";
+            case JobCancelled:
+                return "Cancelled";
+        }
+        
+        return "";
+    }
+    
+    static void DrawJob(const Job &job, float y) {
+        char status[96] = { 0 };
+        
+        if (job.IsFinished())
+            Progress::GetSummary(job.info, status, sizeof(status));
+        else if ((job.state == JobRunning) || (job.state == JobPaused))
+            Progress::GetStatus(job.info, status, sizeof(status));
+            
+        std::string title = Jobs::GetTitle(job);
+        if (title.length() > 40) {
+            title.resize(40);
+            title.append("...");
+        }
+        
+        const char *state = GUI::GetStateName(job);
+        float state_width = 0.f;
+        C2D::GetTextSize(0.42f, &state_width, nullptr, state);
+        
+        C2D::Text(10, y + 3, 0.44f, cfg.dark_theme? WHITE : BLACK, title);
+        C2D::Text(310 - state_width, y + 3, 0.42f, cfg.dark_theme? TITLE_COLOUR_DARK : TITLE_COLOUR, state);
+        C2D::Text(10, y + 19, 0.42f, cfg.dark_theme? TEXT_MIN_COLOUR_DARK : TEXT_MIN_COLOUR_LIGHT, status);
+        
+        u64 done = job.info.total_bytes > 0? job.info.bytes : job.info.files;
+        u64 total = job.info.total_bytes > 0? job.info.total_bytes : job.info.total_files;
+        
+        if ((total > 0) && (job.state != JobQueued)) {
+            C2D::Rect(10, y + 38, 300, 3, cfg.dark_theme? SELECTOR_COLOUR_DARK : BAR_COLOUR);
+            C2D::Rect(10, y + 38, static_cast<int>((static_cast<float>(done > total? total : done) / static_cast<float>(total)) * 300.f), 3, 
+                cfg.dark_theme? TITLE_COLOUR_DARK : TITLE_COLOUR);
+        }
+    }
+    
+    void DisplayJobs(MenuItem *item) {
+        Jobs::GetJobs(jobs);
+        Utils::SetBounds(&selection, 0, jobs.empty()? 0 : jobs.size() - 1);
+        
+        C2D::Rect(0, 20, 400, 35, cfg.dark_theme? MENU_BAR_DARK : STATUS_BAR_LIGHT); // Menu bar
+        C2D::Rect(0, 55, 320, 185, cfg.dark_theme? BLACK_BG : WHITE);
+        C2D::Text(10, 30, 0.44f, WHITE, "Jobs");
+        C2D::Text(70, 31, 0.42f, WHITE, "A: pause/resume  X: cancel  Y: clear");
+        
+        if (jobs.empty()) {
+            C2D::Text(10, 63, 0.42f, cfg.dark_theme? WHITE : BLACK, "No jobs.");
+            return;
+        }
+        
+        C2D::Rect(0, 55 + ((selection - jobs_view.start) * jobs_view.row_height), 320, jobs_view.row_height, 
+            cfg.dark_theme? SELECTOR_COLOUR_DARK : SELECTOR_COLOUR_LIGHT);
+            
+        GUI::DrawListView(&jobs_view, jobs.size(), [](int i, float y) {
+            GUI::DrawJob(jobs[i], y);
+        });
+    }
+    
+    void ControlJobs(MenuItem *item, u32 *kDown) {
+        if (*kDown & KEY_DUP)
+            selection--;
+        else if (*kDown & KEY_DDOWN)
+            selection++;
+            
+        int row = GUI::GetTouchedRow(&jobs_view, jobs.size());
+        if ((row != -1) && (*kDown & KEY_TOUCH))
+            selection = row;
+            
+        Utils::SetBounds(&selection, 0, jobs.empty()? 0 : jobs.size() - 1);
+        
+        if ((*kDown & KEY_A) && (!jobs.empty())) {
+            const Job &job = jobs[selection];
+            
+            if ((job.state == JobPaused) || ((job.state == JobQueued) && (job.held)))
+                Jobs::Resume(job.id);
+            else
+                Jobs::Pause(job.id);
+        }
+        else if ((*kDown & KEY_X) && (!jobs.empty()))
+            Jobs::Cancel(jobs[selection].id);
+        else if (*kDown & KEY_Y) {
+            Jobs::ClearFinished();
+            selection = 0;
+            jobs_view.start = 0;
+        }
+        else if (*kDown & (KEY_B | KEY_SELECT)) {
+            selection = 0;
+            jobs_view.start = 0;
+            item->state = MENU_STATE_FILEBROWSER;
+        }
+        
+        GUI::ScrollListView(&jobs_view, selection, jobs.size());
+    }
+    
+    // Anything that can't run alongside the queue (installing an update) waits here for it to drain first. Paused and
+    // held jobs are resumed, nothing would finish them otherwise. Returns false if B gave up on the wait.
+    bool WaitForJobs(void) {
+        ProgressInfo info;
+        char status[96];
+        
+        Jobs::GetJobs(jobs);
+        for (const Job &job : jobs) {
+            if ((job.state == JobPaused) || ((job.state == JobQueued) && (job.held)))
+                Jobs::Resume(job.id);
+        }
+        
+        while ((Jobs::GetActiveCount() > 0) && (aptMainLoop())) {
+            hidScanInput();
+            if (hidKeysDown() & KEY_B)
+                return false;
+                
+            Jobs::GetJobs(jobs);
+            info = ProgressInfo();
+            
+            for (const Job &job : jobs) {
+                if ((job.state == JobRunning) || (job.state == JobPaused))
+                    info = job.info;
+            }
+            
+            Progress::GetStatus(info, status, sizeof(status));
+            GUI::ProgressBar("Waiting for jobs (B to cancel)", info.name, info.total_bytes > 0? info.bytes : info.offset, 
+                info.total_bytes > 0? info.total_bytes : info.size, status);
+        }
+        
+        return (Jobs::GetActiveCount() == 0);
+    }
+    
+    // Offers to pick up a copy or move that was cut short the last time the app ran.
+    void CheckInterrupted(MenuItem *item) {
+        if (!Journal::Load(interrupted))
+            return;
+            
+        interrupted_title = Jobs::GetTitle(interrupted);
+        if (interrupted_title.length() > 40) {
+            interrupted_title.resize(40);
+            interrupted_title.append("...");
+        }
+        
+        selection = 1;
+        item->state = MENU_STATE_RESUME;
+    }
+    
+    static void Resume(MenuItem *item, bool resume) {
+        if (resume) {
+            interrupted.resume = true;
+            Jobs::Add(interrupted);
+        }
+        else
+            Journal::Discard();
+            
+        interrupted = Job();
+        selection = 0;
+        item->state = MENU_STATE_FILEBROWSER;
+    }
+    
+    void DisplayResume(MenuItem *item) {
+        float title_width = 0.f, prompt_width = 0.f;
+        
+        C2D::Image(cfg.dark_theme? dialog_dark : dialog, ((320 - (dialog.subtex->width)) / 2), ((240 - (dialog.subtex->height)) / 2));
+        C2D::Text(((320 - (dialog.subtex->width)) / 2) + 6, ((240 - (dialog.subtex->height)) / 2) + 6 - 3, 0.42f, cfg.dark_theme? TITLE_COLOUR_DARK : TITLE_COLOUR, "Resume");
+        
+        C2D::GetTextSize(0.42f, &title_width, nullptr, interrupted_title);
+        C2D::GetTextSize(0.42f, &prompt_width, nullptr, "was interrupted. Do you wish to resume it?");
+        C2D::Text(((320 - (title_width)) / 2), ((240 - (dialog.subtex->height)) / 2) + 32 - 3, 0.42f, cfg.dark_theme? TEXT_MIN_COLOUR_DARK : TEXT_MIN_COLOUR_LIGHT, interrupted_title);
+        C2D::Text(((320 - (prompt_width)) / 2), ((240 - (dialog.subtex->height)) / 2) + 48 - 3, 0.42f, cfg.dark_theme? TEXT_MIN_COLOUR_DARK : TEXT_MIN_COLOUR_LIGHT, 
+            "was interrupted. Do you wish to resume it?");
+            
+        C2D::GetTextSize(0.42f, &confirm_width, &confirm_height, "YES");
+        C2D::GetTextSize(0.42f, &cancel_width, &cancel_height, "NO");
+        
+        if (selection == 0)
+            C2D::Rect((288 - cancel_width) - 5, (159 - cancel_height) - 5, cancel_width + 10, cancel_height + 10, cfg.dark_theme? SELECTOR_COLOUR_DARK : SELECTOR_COLOUR_LIGHT);
+        else
+            C2D::Rect((248 - (confirm_width)) - 5, (159 - confirm_height) - 5, confirm_width + 10, confirm_height + 10, cfg.dark_theme? SELECTOR_COLOUR_DARK : SELECTOR_COLOUR_LIGHT);
+            
+        C2D::Text(248 - (confirm_width), (159 - confirm_height) - 3, 0.42f, cfg.dark_theme? TITLE_COLOUR_DARK : TITLE_COLOUR, "YES");
+        C2D::Text(288 - cancel_width, (159 - cancel_height) - 3, 0.42f, cfg.dark_theme? TITLE_COLOUR_DARK : TITLE_COLOUR, "NO");
+    }
+    
+    // Declining throws the journal away, whatever was already copied is left where it is.
+    void ControlResume(MenuItem *item, u32 *kDown) {
+        if (*kDown & KEY_RIGHT)
+            selection++;
+        else if (*kDown & KEY_LEFT)
+            selection--;
+            
+        Utils::SetBounds(&selection, 0, 1);
+        
+        if (*kDown & KEY_A)
+            GUI::Resume(item, selection == 1);
+        else if (*kDown & KEY_B)
+            GUI::Resume(item, false);
+        else if (Touch::Rect((288 - cancel_width) - 5, (159 - cancel_height) - 5, ((288 - cancel_width) - 5) + cancel_width + 10, ((159 - cancel_height) - 5) + cancel_height + 10)) {
+            selection = 0;
+            
+            if (*kDown & KEY_TOUCH)
+                GUI::Resume(item, false);
+        }
+        else if (Touch::Rect((248 - (confirm_width)) - 5, (159 - confirm_height) - 5, ((248 - (confirm_width)) - 5) + confirm_width + 10, ((159 - confirm_height) - 5) + confirm_height + 10)) {
+            selection = 1;
+            
+            if (*kDown & KEY_TOUCH)
+                GUI::Resume(item, true);
+        }
+    }
+}
@@ -0,0 +1,28 @@
+#include <algorithm>
+
+#include "list_view.h"
+#include "touch.h"
+
+namespace GUI {
+    // Scrolls just enough to bring the selected row on screen, and never past the end of the list.
+    void ScrollListView(ListView *view, int selected, int count) {
+        if (selected < view->start)
+            view->start = selected;
+        else if (selected >= (view->start + view->visible))
+            view->start = selected - view->visible + 1;
+            
+        int max_start = (count > view->visible)? (count - view->visible) : 0;
+        view->start = std::clamp(view->start, 0, max_start);
+    }
+    
+    // Returns the index of the row under the stylus, or -1 if the touch is outside the rows on screen.
+    int GetTouchedRow(const ListView *view, int count) {
+        float x = Touch::GetX(), y = Touch::GetY();
+        
+        if ((x < view->x) || (x >= (view->x + view->width)) || (y < view->y) || (y >= (view->y + (view->visible * view->row_height))))
+            return -1;
+            
+        int index = view->start + static_cast<int>((y - view->y) / view->row_height);
+        return (index < count)? index : -1;
+    }
+}
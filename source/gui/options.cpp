@@ -1,18 +1,20 @@
-#include <codecvt>
-#include <locale>
-
 #include "c2d_helper.h"
 #include "colours.h"
 #include "config.h"
+#include "dir_cache.h"
 #include "fs.h"
 #include "gui.h"
+#include "jobs.h"
+#include "log.h"
 #include "osk.h"
 #include "textures.h"
 #include "touch.h"
+#include "undo.h"
 #include "utils.h"
 
 static int row = 0, column = 0;
 static bool copy = false, move = false, options_more = false;
+static Job clipboard;
 
 namespace Options {
     static void ResetSelector(void) {
@@ -20,57 +22,62 @@ namespace Options {
         column = 0;
     }
 
-    static void HandleMultipleCopy(MenuItem *item, Result (*func)()) {
-        Result ret = 0;
-        std::vector<FS_DirectoryEntry> entries;
-        
-        if (R_FAILED(ret = FS::GetDirList(item->checked_cwd.data(), entries)))
-            return;
-            
-        for (u32 i = 0; i < item->checked_copy.size(); i++) {
-            if (item->checked_copy.at(i)) {
-                FS::Copy(&entries[i], item->checked_cwd);
-                if (R_FAILED((*func)())) {
-                    FS::GetDirList(cfg.cwd, item->entries);
-                    GUI::ResetCheckbox(item);
-                    break;
-                }
-            }
-        }
-        
-        FS::GetDirList(cfg.cwd, item->entries);
-        GUI::ResetCheckbox(item);
-        entries.clear();
+    static void RecordCreate(const std::string &name, bool dir) {
+        UndoEntry entry;
+        entry.type = UndoCreate;
+        entry.src_archive = archive;
+        entry.dest_archive = archive;
+        entry.dir = dir;
+        entry.src = cfg.cwd + name;
+        Undo::Record(entry);
     }
 
     static void CreateFolder(MenuItem *item) {
-        std::string path = cfg.cwd;
         std::string name = OSK::GetText("New Folder", "Enter folder name");
-        path.append(name);
-        std::u16string path_u16 = std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t>{}.from_bytes(path.data());
         
-        if (R_SUCCEEDED(FSUSER_CreateDirectory(archive, fsMakePath(PATH_UTF16, path_u16.c_str()), 0))) {
+        if (R_SUCCEEDED(FS::MakeDir(name))) {
+            Options::RecordCreate(name, true);
             FS::GetDirList(cfg.cwd, item->entries);
             GUI::ResetCheckbox(item);
         }
     }
 
     static void CreateFile(MenuItem *item) {
-        std::string path = cfg.cwd;
         std::string name = OSK::GetText("New File", "Enter file name");
-        path.append(name);
-        std::u16string path_u16 = std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t>{}.from_bytes(path.data());
         
-        if (R_SUCCEEDED(FSUSER_CreateFile(archive, fsMakePath(PATH_UTF16, path_u16.c_str()), 0, 0))) {
+        if (R_SUCCEEDED(FS::MakeFile(name))) {
+            Options::RecordCreate(name, false);
             FS::GetDirList(cfg.cwd, item->entries);
             GUI::ResetCheckbox(item);
         }
     }
 
     static void Rename(MenuItem *item, const std::string &filename) {
+        // Renaming something a queued or running job still has to read or write would pull it out from under the job.
+        if (Jobs::IsBusy(archive, cfg.cwd + filename)) {
+            Log::Error("Rename(%s): in use by a job\n", filename.c_str());
+            return;
+        }
+        
         std::string path = OSK::GetText(filename, "Enter new name");
+        bool dir = item->entries.IsDir(item->selected);
+        
+        // Nor may it take a name a job is still going to write to.
+        if (Jobs::IsBusy(archive, cfg.cwd + path)) {
+            Log::Error("Rename(%s): %s in use by a job\n", filename.c_str(), path.c_str());
+            return;
+        }
 
-        if (R_SUCCEEDED(FS::Rename(&item->entries[item->selected], path.c_str()))) {
+        if (R_SUCCEEDED(FS::Rename(item->entries, item->selected, path.c_str()))) {
+            UndoEntry entry;
+            entry.type = UndoRename;
+            entry.src_archive = archive;
+            entry.dest_archive = archive;
+            entry.dir = dir;
+            entry.src = cfg.cwd + filename;
+            entry.dest = cfg.cwd + path;
+            Undo::Record(entry);
+            
             FS::GetDirList(cfg.cwd, item->entries);
             Options::ResetSelector();
             options_more = false;
@@ -78,27 +85,61 @@ namespace Options {
         }
     }
 
+    // Reverses the last rename, move, new entry or delete to the trash. A move back runs as a job, the listing is
+    // refreshed again once it finishes.
+    static void UndoLast(MenuItem *item) {
+        Undo::Revert();
+        DirCache::Invalidate(archive, cfg.cwd);
+        FS::GetDirList(cfg.cwd, item->entries);
+        GUI::ResetCheckbox(item);
+        Options::ResetSelector();
+        options_more = false;
+        item->state = MENU_STATE_FILEBROWSER;
+    }
+
+    // Remembers what to copy or move: every checked entry if more than one is checked here, the selected one otherwise.
+    static void SetClipboard(MenuItem *item) {
+        clipboard = Job();
+        clipboard.src_archive = archive;
+        clipboard.src_dir = cfg.cwd;
+        
+        if ((item->checked_count > 1) && (!item->checked_cwd.compare(cfg.cwd))) {
+            for (u32 i = 0; i < item->checked.size(); i++) {
+                if (item->checked.at(i))
+                    clipboard.AddItem(item->entries.GetName(i), item->entries.IsDir(i));
+            }
+        }
+        else
+            clipboard.AddItem(item->entries.GetName(item->selected), item->entries.IsDir(item->selected));
+    }
+    
+    // Queues the clipboard into the current folder, the browser stays usable while the job runs.
+    static void Paste(MenuItem *item, JobType type) {
+        if ((clipboard.src_archive == archive) && (!clipboard.src_dir.compare(cfg.cwd))) {
+            Log::Error("Paste(%s): source and destination are the same folder\n", cfg.cwd.c_str());
+            return;
+        }
+        
+        clipboard.type = type;
+        clipboard.dest_archive = archive;
+        clipboard.dest_dir = cfg.cwd;
+        clipboard.conflict = static_cast<ConflictPolicy>(cfg.conflict_policy);
+        Jobs::Add(clipboard);
+        clipboard = Job();
+        GUI::ResetCheckbox(item);
+    }
+
     static void Copy(MenuItem *item) {
         if (!copy) {
             if ((item->checked_count >= 1) && (item->checked_cwd.compare(cfg.cwd) != 0))
                 GUI::ResetCheckbox(item);
-            if (item->checked_count <= 1)
-                FS::Copy(&item->entries[item->selected], cfg.cwd);
-            
+                
+            Options::SetClipboard(item);
             copy = !copy;
             item->state = MENU_STATE_FILEBROWSER;
         }
         else {
-            if ((item->checked_count > 1) && (item->checked_cwd.compare(cfg.cwd) != 0))
-                Options::HandleMultipleCopy(item, &FS::Paste);
-            else {
-                if (R_SUCCEEDED(FS::Paste())) {
-                    FS::GetDirList(cfg.cwd, item->entries);
-                    GUI::ResetCheckbox(item);
-                }
-            }
-            
-            GUI::RecalcStorageSize(item);
+            Options::Paste(item, JobCopy);
             copy = !copy;
             item->state = MENU_STATE_FILEBROWSER;
         }
@@ -109,17 +150,10 @@ namespace Options {
             if ((item->checked_count >= 1) && (item->checked_cwd.compare(cfg.cwd) != 0))
                 GUI::ResetCheckbox(item);
                 
-            if (item->checked_count <= 1)
-                FS::Copy(&item->entries[item->selected], cfg.cwd);
-        }
-        else {
-            if ((item->checked_count > 1) && (item->checked_cwd.compare(cfg.cwd) != 0))
-                Options::HandleMultipleCopy(item, &FS::Move);
-            else if (R_SUCCEEDED(FS::Move())) {
-                FS::GetDirList(cfg.cwd, item->entries);
-                GUI::ResetCheckbox(item);
-            }
+            Options::SetClipboard(item);
         }
+        else
+            Options::Paste(item, JobMove);
         
         move = !move;
         item->state = MENU_STATE_FILEBROWSER;
@@ -166,6 +200,9 @@ namespace GUI {
             C2D::Text(66, 78, 0.42f, cfg.dark_theme? TEXT_MIN_COLOUR_DARK : TEXT_MIN_COLOUR_LIGHT, "New folder");
             C2D::Text(66, 114, 0.42f, cfg.dark_theme? TEXT_MIN_COLOUR_DARK : TEXT_MIN_COLOUR_LIGHT, "Rename");
             C2D::Text(170, 78, 0.42f, cfg.dark_theme? TEXT_MIN_COLOUR_DARK : TEXT_MIN_COLOUR_LIGHT, "New file");
+            
+            const char *undo_label = Undo::GetLabel();
+            C2D::Text(170, 114, 0.42f, cfg.dark_theme? TEXT_MIN_COLOUR_DARK : TEXT_MIN_COLOUR_LIGHT, *undo_label? undo_label : "Undo");
         }
     }
 
@@ -185,17 +222,12 @@ namespace GUI {
             Utils::SetBounds(&column, 0, 3);
         }
         else {
+            Utils::SetBounds(&row, 0, 1);
             Utils::SetBounds(&column, 0, 2);
-            
-            if (column == 1)
-                Utils::SetBounds(&row, 0, 0);
-            else
-                Utils::SetBounds(&row, 0, 1);
         }
 
         if (*kDown & KEY_A) {
-            const std::u16string entry_name_utf16 = reinterpret_cast<const char16_t *>(item->entries[item->selected].name);
-            const std::string filename = std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t>{}.to_bytes(entry_name_utf16.data());
+            const std::string filename = item->entries.GetUTF8Name(item->selected);
 
             if (row == 0) {
                 if (!options_more) {
@@ -216,6 +248,8 @@ namespace GUI {
             else if (row == 1) {
                 if (!options_more) {
                     if (column == 0) {
+                        // An explicit refresh always goes back to the disk.
+                        DirCache::Invalidate(archive, cfg.cwd);
                         FS::GetDirList(cfg.cwd, item->entries);
                         Options::ResetSelector();
                         options_more = false;
@@ -232,6 +266,8 @@ namespace GUI {
                 else {
                     if (column == 0)
                         Options::CreateFile(item);
+                    else if (column == 1)
+                        Options::UndoLast(item);
                 }
             }
             if (column == 3) {
@@ -268,6 +304,7 @@ namespace GUI {
             
             if (*kDown & KEY_TOUCH) {
                 if (!options_more) {
+                    DirCache::Invalidate(archive, cfg.cwd);
                     FS::GetDirList(cfg.cwd, item->entries);
                     Options::ResetSelector();
                     options_more = false;
@@ -286,18 +323,21 @@ namespace GUI {
                 if (!options_more)
                     Options::Copy(item);
                 else {
-                    const std::u16string entry_name_utf16 = reinterpret_cast<const char16_t *>(item->entries[item->selected].name);
-                    const std::string filename = std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t>{}.to_bytes(entry_name_utf16.data());
+                    const std::string filename = item->entries.GetUTF8Name(item->selected);
                     Options::Rename(item, filename);
                 }
             }
         }
-        else if ((Touch::Rect(160, 105, 263, 141)) && (!options_more)) {
+        else if (Touch::Rect(160, 105, 263, 141)) {
             row = 1;
             column = 1;
             
-            if (*kDown & KEY_TOUCH)
-                Options::Move(item);
+            if (*kDown & KEY_TOUCH) {
+                if (!options_more)
+                    Options::Move(item);
+                else
+                    Options::UndoLast(item);
+            }
         }
         else if ((Touch::Rect(56, 142, 159, 178)) && (!options_more)) {
             row = 0;
@@ -0,0 +1,341 @@
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+
+#include "gui.h"
+#include "log.h"
+#include "progress.h"
+
+// Long running operations only bump atomic counters here. A modal operation gets a separate thread that draws the
+// progress dialog at display rate (and watches for B), so the I/O never waits on vsync. Background jobs are drawn by the
+// jobs panel from GetInfo() instead. Progress is tracked for the whole operation: bytes and files done out of everything
+// planned so far, with the current file shown underneath. Only one operation is tracked at a time.
+namespace Progress {
+    static const u64 rate_interval = 500; // ms between throughput samples
+    static const u64 pause_interval = 100000000; // ns between checks while paused
+    
+    static Thread thread = nullptr;
+    static LightLock lock;
+    static std::string title, name;
+    static std::atomic<u64> offset(0), size(0), total(0), total_bytes(0);
+    static std::atomic<u32> files(0), total_files(0), failed(0), skipped(0), verified(0), mismatches(0);
+    static std::atomic<u64> verify_time(0);
+    static std::atomic<int> durability(-1);
+    static std::atomic<bool> running(false), paused(false), cancelled(false);
+    static u32 depth = 0;
+    static u64 start_time = 0, end_time = 0;
+    static u64 last_time = 0, last_total = 0, rate = 0;
+    static u32 last_files = 0, file_rate = 0;
+    static bool modal = false;
+    
+    static void FormatTime(char *buf, std::size_t length, u64 seconds) {
+        std::snprintf(buf, length, "%llu:%02llu", seconds / 60, seconds % 60);
+    }
+    
+    // Throughput is averaged over rate_interval and smoothed, single chunks complete too unevenly to show as is.
+    // Only whoever is drawing the progress calls this.
+    static void UpdateRate(void) {
+        u64 now = osGetTime();
+        if ((now - last_time) < rate_interval)
+            return;
+            
+        u64 current = total;
+        u64 sample = ((current - last_total) * 1000) / (now - last_time);
+        rate = (rate == 0)? sample : ((rate * 3) + sample) / 4;
+        last_total = current;
+        
+        u32 current_files = files;
+        u32 file_sample = ((current_files - last_files) * 1000) / (now - last_time);
+        file_rate = (file_rate == 0)? file_sample : ((file_rate * 3) + file_sample) / 4;
+        last_files = current_files;
+        last_time = now;
+    }
+    
+    void GetStatus(const ProgressInfo &info, char *status, std::size_t length) {
+        int count = 0;
+        status[0] = '\0';
+        
+        if (info.total_files > 1)
+            count = std::snprintf(status, length, "%lu/%lu - ", info.files, info.total_files);
+            
+        if (info.paused) {
+            std::snprintf(status + count, length - count, "Paused");
+            return;
+        }
+        
+        // Operations that move no data (deleting) are measured in files instead.
+        if ((info.total_bytes == 0) && (info.size == 0) && (info.file_rate > 0) && (info.total_files > 1)) {
+            char eta[16];
+            Progress::FormatTime(eta, sizeof(eta), info.total_files > info.files? ((info.total_files - info.files) / info.file_rate) : 0);
+            std::snprintf(status + count, length - count, "%lu files/s - %s left", info.file_rate, eta);
+            return;
+        }
+        
+        if (info.rate == 0)
+            return;
+            
+        // The ETA covers the whole operation when its size is known and the current file otherwise.
+        u64 done = info.bytes, planned = info.total_bytes;
+        if (planned == 0) {
+            done = info.offset;
+            planned = info.size;
+        }
+        
+        char eta[16];
+        Progress::FormatTime(eta, sizeof(eta), planned > done? ((planned - done) / info.rate) : 0);
+        std::snprintf(status + count, length - count, "%.2f MB/s - %s left", static_cast<double>(info.rate) / (1024.0 * 1024.0), eta);
+    }
+    
+    // Verification overhead is the share of the elapsed time spent re-reading destinations and copying files again.
+    static void GetVerifyStatus(const ProgressInfo &info, char *status, std::size_t length) {
+        u64 ms = info.elapsed > 0? info.elapsed : 1;
+        std::snprintf(status, length, "%lu verified, %lu mismatched - +%.1fs (%llu%%)", info.verified, info.mismatches, 
+            static_cast<double>(info.verify_time) / 1000.0, (info.verify_time * 100) / ms);
+    }
+    
+    void GetSummary(const ProgressInfo &info, char *summary, std::size_t length) {
+        char time[16];
+        u64 ms = info.elapsed > 0? info.elapsed : 1;
+        Progress::FormatTime(time, sizeof(time), info.elapsed / 1000);
+        int count = 0;
+        
+        if (info.bytes > 0)
+            count = std::snprintf(summary, length, "%lu files in %s, %lu failed - %.2f MB/s", info.files, time, info.failed, 
+                (static_cast<double>(info.bytes) * 1000.0) / (static_cast<double>(ms) * 1024.0 * 1024.0));
+        else
+            count = std::snprintf(summary, length, "%lu files in %s, %lu failed - %.1f files/s", info.files, time, info.failed, 
+                (static_cast<double>(info.files) * 1000.0) / static_cast<double>(ms));
+            
+        if ((info.skipped > 0) && (count > 0) && (static_cast<std::size_t>(count) < length))
+            count += std::snprintf(summary + count, length - count, ", %lu skipped", info.skipped);
+            
+        if ((info.durability >= 0) && (count > 0) && (static_cast<std::size_t>(count) < length))
+            count += std::snprintf(summary + count, length - count, ", %s", Durability::GetSummary(static_cast<DurabilityMode>(info.durability)));
+            
+        if ((info.verified > 0) && (count > 0) && (static_cast<std::size_t>(count) + 2 < length)) {
+            std::snprintf(summary + count, length - count, ", ");
+            Progress::GetVerifyStatus(info, summary + count + 2, length - count - 2);
+        }
+    }
+    
+    static void ProgressThread(void *args) {
+        ProgressInfo info;
+        char status[64] = { 0 };
+        
+        while (running) {
+            hidScanInput();
+            if (hidKeysDown() & KEY_B)
+                cancelled = true;
+                
+            Progress::GetInfo(&info);
+            Progress::GetStatus(info, status, sizeof(status));
+            
+            if (info.total_bytes > 0)
+                GUI::ProgressBar(info.title, info.name, info.bytes, info.total_bytes, status);
+            else
+                GUI::ProgressBar(info.title, info.name, info.offset, info.size, status);
+        }
+    }
+    
+    // Shown once a modal operation covering more than one file (or with failures) finishes, until A or B is pressed.
+    static void DisplaySummary(const ProgressInfo &info) {
+        std::string summary_title = info.title + (info.cancelled? " cancelled" : " complete");
+        char time[16], message[64], status[64];
+        u64 ms = info.elapsed > 0? info.elapsed : 1;
+        double mb_rate = (static_cast<double>(info.bytes) * 1000.0) / (static_cast<double>(ms) * 1024.0 * 1024.0);
+        
+        Progress::FormatTime(time, sizeof(time), info.elapsed / 1000);
+        
+        // A verified copy uses the status line for the verification figures, the throughput moves up a line.
+        if (info.verified > 0) {
+            std::snprintf(message, sizeof(message), "%lu files in %s, %lu failed - %.2f MB/s", info.files, time, info.failed, mb_rate);
+            Progress::GetVerifyStatus(info, status, sizeof(status));
+        }
+        else {
+            std::snprintf(message, sizeof(message), "%lu files in %s, %lu failed", info.files, time, info.failed);
+            std::snprintf(status, sizeof(status), "%.2f MB/s - %.1f files/s", mb_rate, (static_cast<double>(info.files) * 1000.0) / static_cast<double>(ms));
+        }
+        
+        if (info.durability >= 0) {
+            std::size_t count = std::strlen(message);
+            std::snprintf(message + count, sizeof(message) - count, " - %s", Durability::GetSummary(static_cast<DurabilityMode>(info.durability)));
+        }
+        
+        while (aptMainLoop()) {
+            hidScanInput();
+            if (hidKeysDown() & (KEY_A | KEY_B))
+                break;
+                
+            GUI::ProgressBar(summary_title, message, info.bytes, info.total_bytes > 0? info.total_bytes : info.bytes, status);
+        }
+    }
+    
+    // Operations may nest (a job with several items runs one copy per item), only the outermost Start() and End()
+    // begin and finish the operation, inner ones just add their work to it.
+    void Init(void) {
+        LightLock_Init(&lock);
+    }
+    
+    void Start(const std::string &title, bool modal) {
+        if (depth++ > 0)
+            return;
+            
+        Progress::title = title;
+        Progress::modal = modal;
+        name.clear();
+        offset = 0;
+        size = 0;
+        total = 0;
+        total_bytes = 0;
+        files = 0;
+        total_files = 0;
+        failed = 0;
+        skipped = 0;
+        verified = 0;
+        mismatches = 0;
+        verify_time = 0;
+        durability = -1;
+        paused = false;
+        cancelled = false;
+        running = true;
+        start_time = osGetTime();
+        end_time = 0;
+        last_time = start_time;
+        last_total = 0;
+        rate = 0;
+        last_files = 0;
+        file_rate = 0;
+        
+        if (!modal)
+            return;
+            
+        // Same arrangement as the download progress: just above the caller, which keeps doing the I/O.
+        s32 prio = 0;
+        svcGetThreadPriority(&prio, CUR_THREAD_HANDLE);
+        thread = threadCreate(Progress::ProgressThread, nullptr, 32 * 1024, prio - 1, -2, false);
+        
+        if (!thread)
+            Log::Error("threadCreate(ProgressThread) failed\n");
+    }
+    
+    void AddTotal(u64 bytes, u32 files) {
+        total_bytes += bytes;
+        total_files += files;
+    }
+    
+    void SetItem(const std::string &name, u64 size) {
+        LightLock_Lock(&lock);
+        Progress::name = name;
+        LightLock_Unlock(&lock);
+        
+        offset = 0;
+        Progress::size = size;
+    }
+    
+    void Add(u64 bytes) {
+        offset += bytes;
+        total += bytes;
+    }
+    
+    void ItemDone(Result ret) {
+        files++;
+        
+        if (R_FAILED(ret))
+            failed++;
+    }
+    
+    // Files the destination already had and keeps, taken back out of the totals.
+    void AddSkipped(u32 files, u64 bytes) {
+        skipped += files;
+        total_files -= files;
+        total_bytes -= bytes;
+    }
+    
+    // One verified file, ms covers its re-read and any retries.
+    void AddVerify(u64 ms, u32 mismatches) {
+        verified++;
+        verify_time += ms;
+        Progress::mismatches += mismatches;
+    }
+    
+    // Shown in the summary, for operations whose writes follow a durability setting.
+    void SetDurability(DurabilityMode mode) {
+        durability = mode;
+    }
+    
+    // Every I/O loop checks this once per chunk, so it is also where a paused operation waits.
+    bool IsCancelled(void) {
+        while ((paused) && (!cancelled))
+            svcSleepThread(pause_interval);
+            
+        return cancelled;
+    }
+    
+    void SetPaused(bool paused) {
+        Progress::paused = paused;
+    }
+    
+    void Cancel(void) {
+        cancelled = true;
+    }
+    
+    void GetInfo(ProgressInfo *info) {
+        if (running)
+            Progress::UpdateRate();
+            
+        LightLock_Lock(&lock);
+        info->title = title;
+        info->name = name;
+        LightLock_Unlock(&lock);
+        
+        info->offset = offset;
+        info->size = size;
+        info->bytes = total;
+        info->total_bytes = total_bytes;
+        info->files = files;
+        info->total_files = total_files;
+        info->failed = failed;
+        info->skipped = skipped;
+        info->verified = verified;
+        info->mismatches = mismatches;
+        info->verify_time = verify_time;
+        info->durability = durability;
+        info->rate = rate;
+        info->file_rate = file_rate;
+        info->elapsed = (running? osGetTime() : end_time) - start_time;
+        info->paused = paused;
+        info->cancelled = cancelled;
+    }
+    
+    void End(void) {
+        if ((depth == 0) || (--depth > 0))
+            return;
+            
+        running = false;
+        paused = false;
+        end_time = osGetTime();
+        
+        if (thread) {
+            threadJoin(thread, U64_MAX);
+            threadFree(thread);
+            thread = nullptr;
+        }
+        
+        ProgressInfo info;
+        Progress::GetInfo(&info);
+        u64 ms = info.elapsed > 0? info.elapsed : 1;
+        
+        Log::Debug("Progress(%s): %lu/%lu files, %lu failed, %llu/%llu bytes in %llu ms (%.2f MB/s, %.1f files/s)%s\n", info.title.c_str(), 
+            info.files, info.total_files, info.failed, info.bytes, info.total_bytes, info.elapsed, 
+            (static_cast<double>(info.bytes) * 1000.0) / (static_cast<double>(ms) * 1024.0 * 1024.0), 
+            (static_cast<double>(info.files) * 1000.0) / static_cast<double>(ms), info.cancelled? ", cancelled" : "");
+            
+        if (info.verified > 0)
+            Log::Debug("Progress(%s): %lu files verified, %lu mismatched, %llu ms verifying\n", info.title.c_str(), info.verified, info.mismatches, 
+                info.verify_time);
+                
+
+        if ((modal) && ((info.total_files > 1) || (info.failed > 0)))
+            Progress::DisplaySummary(info);
+    }
+}
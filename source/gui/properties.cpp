@@ -17,9 +17,9 @@ namespace GUI {
 
         C2D::Textf(66, 57, 0.42f, cfg.dark_theme? TEXT_MIN_COLOUR_DARK : TEXT_MIN_COLOUR_LIGHT,
             cfg.cwd.length() > 22? "Parent: %.22s..." : "Parent: %s", cfg.cwd.c_str());
-        if (!(item->entries[item->selected].attributes & FS_ATTRIBUTE_DIRECTORY)) {
+        if (!item->entries.IsDir(item->selected)) {
             char utils_size[16];
-            Utils::GetSizeString(utils_size, static_cast<double>(item->entries[item->selected].fileSize));
+            Utils::GetSizeString(utils_size, static_cast<double>(item->entries.GetSize(item->selected)));
             C2D::Textf(66, 73, 0.42f, cfg.dark_theme? TEXT_MIN_COLOUR_DARK : TEXT_MIN_COLOUR_LIGHT, "Size: %s", utils_size);
         }
 
@@ -3,8 +3,11 @@
 #include "c2d_helper.h"
 #include "colours.h"
 #include "config.h"
+#include "conflict.h"
+#include "durability.h"
 #include "fs.h"
 #include "gui.h"
+#include "list_view.h"
 #include "net.h"
 #include "textures.h"
 #include "touch.h"
@@ -14,6 +17,7 @@ namespace GUI {
     enum SETTINGS_STATE {
         GENERAL_SETTINGS,
         SORT_SETTINGS,
+        TRANSFER_SETTINGS,
         UPDATE_SETTINGS
     };
     
@@ -23,22 +27,95 @@ namespace GUI {
     static std::string tag_name = std::string();
     static bool network_status = false, update_available = false, update_popup = false;
 
+    static const int general_count = 5;
+    static ListView general_view = { 0.f, 55.f, 320.f, 40.f, 4, 0 };
+
+    static const char *general_titles[general_count] = {
+        "Sort by",
+        "Dark theme",
+        "Developer options",
+        "Transfers",
+        "Check for update"
+    };
+
+    static const char *general_descriptions[general_count] = {
+        "Select between various sorting options.",
+        "Enables dark theme mode.",
+        "Enable logging and fs access to NAND.",
+        "Verification, conflicts, flushing and trash.",
+        "Downloads and installs the latest version."
+    };
+
+    static const int sort_count = 7;
+    static ListView sort_view = { 0.f, 55.f, 320.f, 40.f, 4, 0 };
+
+    static const char *sort_titles[sort_count] = {
+        "Alphabetical",
+        "Alphabetical",
+        "Size",
+        "Size",
+        "Extension",
+        "Type",
+        "Natural"
+    };
+
+    static const char *sort_descriptions[sort_count] = {
+        "Sort alphabetically in ascending order.",
+        "Sort alphabetically in descending order.",
+        "Sort by size (largest first).",
+        "Sort by size (smallest first).",
+        "Sort by file extension.",
+        "Sort by file type (images, text, archives).",
+        "Sort alphabetically, numbers by value."
+    };
+
+    static const int transfer_count = 8;
+    static ListView transfer_view = { 0.f, 55.f, 320.f, 40.f, 4, 0 };
+
+    static const char *transfer_titles[transfer_count] = {
+        "Verify copies",
+        "If a file exists",
+        "Flush copies",
+        "Flush downloads",
+        "Flush the log",
+        "Flush app data",
+        "Move deletes to trash",
+        "Trash"
+    };
+
+    static const char *transfer_descriptions[transfer_count] = {
+        "Re-read and check every copied file.",
+        "When pasting, moving or extracting.",
+        "Copying, moving and extracting.",
+        "Updates and installs.",
+        "The developer log.",
+        "Settings, journals and the trash index.",
+        "Deleted items can be restored later.",
+        "Restore or permanently delete trashed items."
+    };
+
+    // The class each of the flush rows (2 to 5) sets.
+    static const DurabilityClass transfer_classes[] = {
+        DurabilityCopy,
+        DurabilityDownload,
+        DurabilityLog,
+        DurabilityState
+    };
+
     static void DisplaySortSettings(void) {
         C2D::Text(35, 30, 0.44f, WHITE, "Sorting Options");
-        
-        C2D::Text(10, 58, 0.44f, cfg.dark_theme? WHITE : BLACK, "Alphabetical");
-        C2D::Text(10, 74, 0.42f, cfg.dark_theme? WHITE : BLACK, "Sort alphabetically in ascending order.");
-        C2D::Text(10, 98, 0.44f, cfg.dark_theme? WHITE : BLACK, "Alphabetical");
-        C2D::Text(10, 114, 0.42f, cfg.dark_theme? WHITE : BLACK, "Sort alphabetically in descending order.");
-        C2D::Text(10, 138, 0.44f, cfg.dark_theme? WHITE : BLACK, "Size");
-        C2D::Text(10, 154, 0.42f, cfg.dark_theme? WHITE : BLACK, "Sort by size (largest first).");
-        C2D::Text(10, 178, 0.44f, cfg.dark_theme? WHITE : BLACK, "Size");
-        C2D::Text(10, 194, 0.42f, cfg.dark_theme? WHITE : BLACK, "Sort by size (smallest first).");
-
-        C2D::Image(cfg.sort == 0? (cfg.dark_theme? icon_radio_dark_on : icon_radio_on) : (cfg.dark_theme? icon_radio_dark_off : icon_radio_off), 270, 60);
-        C2D::Image(cfg.sort == 1? (cfg.dark_theme? icon_radio_dark_on : icon_radio_on) : (cfg.dark_theme? icon_radio_dark_off : icon_radio_off), 270, 100);
-        C2D::Image(cfg.sort == 2? (cfg.dark_theme? icon_radio_dark_on : icon_radio_on) : (cfg.dark_theme? icon_radio_dark_off : icon_radio_off), 270, 140);
-        C2D::Image(cfg.sort == 3? (cfg.dark_theme? icon_radio_dark_on : icon_radio_on) : (cfg.dark_theme? icon_radio_dark_off : icon_radio_off), 270, 180);
+
+        GUI::DrawListView(&sort_view, sort_count, [](int i, float y) {
+            C2D::Text(10, y + 3, 0.44f, cfg.dark_theme? WHITE : BLACK, sort_titles[i]);
+            C2D::Text(10, y + 19, 0.42f, cfg.dark_theme? WHITE : BLACK, sort_descriptions[i]);
+            C2D::Image(cfg.sort == i? (cfg.dark_theme? icon_radio_dark_on : icon_radio_on) : (cfg.dark_theme? icon_radio_dark_off : icon_radio_off), 270, y + 5);
+        });
+    }
+
+    static void SetSortMode(MenuItem *item, int mode) {
+        cfg.sort = mode;
+        Config::Save(cfg);
+        GUI::SortDirList(item);
     }
 
     static void ControlSortSettings(MenuItem *item, u32 *kDown) {
@@ -46,60 +123,34 @@ namespace GUI {
             selection--;
         else if (*kDown & KEY_DDOWN)
             selection++;
-        else if (*kDown & KEY_A) {
-            cfg.sort = selection;
-            Config::Save(cfg);
-            FS::GetDirList(cfg.cwd, item->entries);
-        }
+        else if (*kDown & KEY_A)
+            GUI::SetSortMode(item, selection);
         else if (*kDown & KEY_B) {
             selection = 0;
+            sort_view.start = 0;
             settings_state = GENERAL_SETTINGS;
+            general_view.start = 0;
         }
         
-        if (Touch::Rect(0, 55, 320, 94)) {
-            selection = 0;
-            
-            if (*kDown & KEY_TOUCH) {
-                cfg.sort = selection;
-                Config::Save(cfg);
-                FS::GetDirList(cfg.cwd, item->entries);
-            }
-        }
-        else if (Touch::Rect(0, 95, 320, 134)) {
-            selection = 1;
-            
-            if (*kDown & KEY_TOUCH) {
-                cfg.sort = selection;
-                Config::Save(cfg);
-                FS::GetDirList(cfg.cwd, item->entries);
-            }
-        }
-        else if (Touch::Rect(0, 135, 320, 174)) {
-            selection = 2;
-            
-            if (*kDown & KEY_TOUCH) {
-                cfg.sort = selection;
-                Config::Save(cfg);
-                FS::GetDirList(cfg.cwd, item->entries);
-            }
-        }
-        else if (Touch::Rect(0, 175, 320, 215)) {
-            selection = 3;
-            
-            if (*kDown & KEY_TOUCH) {
-                cfg.sort = selection;
-                Config::Save(cfg);
-                FS::GetDirList(cfg.cwd, item->entries);
-            }
-        }
-        else if (Touch::Rect(5, 25, 30, 50)) {
+        int row = GUI::GetTouchedRow(&sort_view, sort_count);
+        
+        if (Touch::Rect(5, 25, 30, 50)) {
             if (*kDown & KEY_TOUCH) {
                 selection = 0;
+                sort_view.start = 0;
                 settings_state = GENERAL_SETTINGS;
+                general_view.start = 0;
             }
         }
+        else if (row != -1) {
+            selection = row;
+            
+            if (*kDown & KEY_TOUCH)
+                GUI::SetSortMode(item, selection);
+        }
 
-        Utils::SetBounds(&selection, 0, 3);
+        Utils::SetBounds(&selection, 0, sort_count - 1);
+        GUI::ScrollListView(&sort_view, selection, sort_count);
     }
 
     static void DisplayUpdateSettings(void) {
@@ -137,6 +188,7 @@ namespace GUI {
             else if (*kDown & KEY_B) {
                 selection = 0;
                 settings_state = GENERAL_SETTINGS;
+                general_view.start = 0;
             }
             
             Utils::SetBounds(&selection, 0, 2);
@@ -158,96 +210,184 @@ namespace GUI {
             if (*kDown & KEY_TOUCH) {
                 selection = 0;
                 settings_state = GENERAL_SETTINGS;
+                general_view.start = 0;
             }
         }
     }
 
-    static void DisplayGeneralSettings(void) {
-        C2D::Text(10, 30, 0.44f, WHITE, "Settings");
+    static void DisplayTransferSettings(void) {
+        C2D::Text(35, 30, 0.44f, WHITE, "Transfers");
 
-        C2D::Text(10, 58, 0.44f, cfg.dark_theme? WHITE : BLACK, "Sort by");
-        C2D::Text(10, 74, 0.42f, cfg.dark_theme? WHITE : BLACK, "Select between various sorting options.");
-        C2D::Text(10, 98, 0.44f, cfg.dark_theme? WHITE : BLACK, "Dark theme");
-        C2D::Text(10, 114, 0.42f, cfg.dark_theme? WHITE : BLACK, "Enables dark theme mode.");
-        C2D::Text(10, 138, 0.44f, cfg.dark_theme? WHITE : BLACK, "Developer options");
-        C2D::Text(10, 154, 0.42f, cfg.dark_theme? WHITE : BLACK, "Enable logging and fs access to NAND.");
-        C2D::Text(10, 178, 0.44f, cfg.dark_theme? WHITE : BLACK, "Check for update");
-        C2D::Text(10, 194, 0.42f, cfg.dark_theme? WHITE : BLACK, "Downloads and installs the latest version.");
-        
-        if (cfg.dark_theme)
-            C2D::Image(cfg.dark_theme? icon_toggle_dark_on : icon_toggle_on, 270, 97);
-        else
-            C2D::Image(icon_toggle_off, 270, 97);
+        GUI::DrawListView(&transfer_view, transfer_count, [](int i, float y) {
+            C2D::Text(10, y + 3, 0.44f, cfg.dark_theme? WHITE : BLACK, transfer_titles[i]);
+            C2D::Text(10, y + 19, 0.42f, cfg.dark_theme? WHITE : BLACK, transfer_descriptions[i]);
+            
+            const char *value = nullptr;
+            
+            if (i == 0)
+                C2D::Image(cfg.verify_copy? (cfg.dark_theme? icon_toggle_dark_on : icon_toggle_on) : icon_toggle_off, 270, y + 2);
+            else if (i == 1)
+                value = Conflict::GetName(static_cast<ConflictPolicy>(cfg.conflict_policy));
+            else if (i == 6)
+                C2D::Image(cfg.use_trash? (cfg.dark_theme? icon_toggle_dark_on : icon_toggle_on) : icon_toggle_off, 270, y + 2);
+            else if (i != 7)
+                value = Durability::GetName(Durability::GetMode(transfer_classes[i - 2]));
+                
+            if (value) {
+                float value_width = 0.f;
+                C2D::GetTextSize(0.42f, &value_width, nullptr, value);
+                C2D::Text(310 - value_width, y + 3, 0.42f, cfg.dark_theme? TITLE_COLOUR_DARK : TITLE_COLOUR, value);
+            }
+        });
+    }
 
-        C2D::Image(cfg.dev_options? (cfg.dark_theme? icon_toggle_dark_on : icon_toggle_on) : icon_toggle_off, 270, 137);
+    static void CycleDurability(int *mode) {
+        *mode = (*mode + 1) % (DurabilityDeferred + 1);
+        Config::Save(cfg);
     }
 
-    void ControlGeneralSettings(MenuItem *item, u32 *kDown) {
+    static void SelectTransferSetting(MenuItem *item, int index) {
+        switch(index) {
+            case 0:
+                cfg.verify_copy = !cfg.verify_copy;
+                Config::Save(cfg);
+                break;
+
+            case 1:
+                cfg.conflict_policy = (cfg.conflict_policy + 1) % (ConflictRename + 1);
+                Config::Save(cfg);
+                break;
+
+            case 2:
+                GUI::CycleDurability(&cfg.copy_durability);
+                break;
+
+            case 3:
+                GUI::CycleDurability(&cfg.download_durability);
+                break;
+
+            case 4:
+                GUI::CycleDurability(&cfg.log_durability);
+                break;
+
+            case 5:
+                GUI::CycleDurability(&cfg.state_durability);
+                break;
+
+            case 6:
+                cfg.use_trash = !cfg.use_trash;
+                Config::Save(cfg);
+                break;
+
+            case 7:
+                item->state = MENU_STATE_TRASH;
+                break;
+        }
+    }
+
+    static void ControlTransferSettings(MenuItem *item, u32 *kDown) {
         if (*kDown & KEY_DUP)
             selection--;
         else if (*kDown & KEY_DDOWN)
             selection++;
 
-        if (*kDown & KEY_A) {
-            switch(selection) {
-                case 0:
-                    settings_state = SORT_SETTINGS;
-                    selection = 0;
-                    break;
-
-                case 1:
-                    cfg.dark_theme = !cfg.dark_theme;
-                    Config::Save(cfg);
-                    break;
-                
-                case 2:
-                    cfg.dev_options = !cfg.dev_options;
-                    Config::Save(cfg);
-                    break;
-
-                case 3:
-                    settings_state = UPDATE_SETTINGS;
-                    selection = 0;
-                    break;
-            }
-        }
-        else if (*kDown & KEY_B)
-            item->state = MENU_STATE_FILEBROWSER;
+        int row = GUI::GetTouchedRow(&transfer_view, transfer_count);
 
-        if (Touch::Rect(0, 55, 320, 94)) {
+        if (*kDown & KEY_A)
+            GUI::SelectTransferSetting(item, selection);
+        else if (*kDown & KEY_B) {
             selection = 0;
-            
+            transfer_view.start = 0;
+            settings_state = GENERAL_SETTINGS;
+            general_view.start = 0;
+        }
+
+        if (Touch::Rect(5, 25, 30, 50)) {
             if (*kDown & KEY_TOUCH) {
-                settings_state = SORT_SETTINGS;
                 selection = 0;
+                transfer_view.start = 0;
+                settings_state = GENERAL_SETTINGS;
+                general_view.start = 0;
             }
         }
-        else if (Touch::Rect(0, 95, 320, 134)) {
-            selection = 1;
+        else if (row != -1) {
+            selection = row;
             
-            if (*kDown & KEY_TOUCH) {
+            if (*kDown & KEY_TOUCH)
+                GUI::SelectTransferSetting(item, selection);
+        }
+
+        Utils::SetBounds(&selection, 0, transfer_count - 1);
+        GUI::ScrollListView(&transfer_view, selection, transfer_count);
+    }
+
+    static void DisplayGeneralSettings(void) {
+        C2D::Text(10, 30, 0.44f, WHITE, "Settings");
+
+        GUI::DrawListView(&general_view, general_count, [](int i, float y) {
+            C2D::Text(10, y + 3, 0.44f, cfg.dark_theme? WHITE : BLACK, general_titles[i]);
+            C2D::Text(10, y + 19, 0.42f, cfg.dark_theme? WHITE : BLACK, general_descriptions[i]);
+            
+            if (i == 1)
+                C2D::Image(cfg.dark_theme? icon_toggle_dark_on : icon_toggle_off, 270, y + 2);
+            else if (i == 2)
+                C2D::Image(cfg.dev_options? (cfg.dark_theme? icon_toggle_dark_on : icon_toggle_on) : icon_toggle_off, 270, y + 2);
+        });
+    }
+
+    static void SelectGeneralSetting(int index) {
+        switch(index) {
+            case 0:
+                settings_state = SORT_SETTINGS;
+                selection = 0;
+                break;
+
+            case 1:
                 cfg.dark_theme = !cfg.dark_theme;
                 Config::Save(cfg);
-            }
-        }
-        else if (Touch::Rect(0, 135, 320, 174)) {
-            selection = 2;
+                break;
             
-            if (*kDown & KEY_TOUCH) {
+            case 2:
                 cfg.dev_options = !cfg.dev_options;
                 Config::Save(cfg);
-            }
-        }
-        else if (Touch::Rect(0, 175, 320, 215)) {
-            selection = 3;
-            
-            if (*kDown & KEY_TOUCH) {
+                break;
+
+            case 3:
+                settings_state = TRANSFER_SETTINGS;
+                selection = 0;
+                break;
+
+            case 4:
                 settings_state = UPDATE_SETTINGS;
                 selection = 0;
-            }
+                break;
         }
+    }
 
-        Utils::SetBounds(&selection, 0, 3);
+    void ControlGeneralSettings(MenuItem *item, u32 *kDown) {
+        if (*kDown & KEY_DUP)
+            selection--;
+        else if (*kDown & KEY_DDOWN)
+            selection++;
+
+        int row = GUI::GetTouchedRow(&general_view, general_count);
+        
+        if (*kDown & KEY_A)
+            GUI::SelectGeneralSetting(selection);
+        else if (*kDown & KEY_B)
+            item->state = MENU_STATE_FILEBROWSER;
+        else if (row != -1) {
+            selection = row;
+            
+            if (*kDown & KEY_TOUCH)
+                GUI::SelectGeneralSetting(selection);
+        }
+
+        // Leaving the page resets the selection for the next one, only keep the list in step while still here.
+        if (settings_state == GENERAL_SETTINGS) {
+            Utils::SetBounds(&selection, 0, general_count - 1);
+            GUI::ScrollListView(&general_view, selection, general_count);
+        }
     }
 
     void DisplaySettings(MenuItem *item) {
@@ -256,7 +396,15 @@ namespace GUI {
         if (settings_state != GENERAL_SETTINGS)
             C2D::Image(icon_back, 5, 25);
 
-        C2D::Rect(0, 55 + (selection * sel_dist), 320, sel_dist, cfg.dark_theme? SELECTOR_COLOUR_DARK : SELECTOR_COLOUR_LIGHT);
+        int row = selection;
+        if (settings_state == SORT_SETTINGS)
+            row = selection - sort_view.start;
+        else if (settings_state == GENERAL_SETTINGS)
+            row = selection - general_view.start;
+        else if (settings_state == TRANSFER_SETTINGS)
+            row = selection - transfer_view.start;
+            
+        C2D::Rect(0, 55 + (row * sel_dist), 320, sel_dist, cfg.dark_theme? SELECTOR_COLOUR_DARK : SELECTOR_COLOUR_LIGHT);
 
         switch(settings_state) {
             case GENERAL_SETTINGS:
@@ -267,6 +415,10 @@ namespace GUI {
                 DisplaySortSettings();
                 break;
             
+            case TRANSFER_SETTINGS:
+                DisplayTransferSettings();
+                break;
+            
             case UPDATE_SETTINGS:
                 DisplayUpdateSettings();
                 break;
@@ -283,6 +435,10 @@ namespace GUI {
                 ControlSortSettings(item, kDown);
                 break;
             
+            case TRANSFER_SETTINGS:
+                ControlTransferSettings(item, kDown);
+                break;
+            
             case UPDATE_SETTINGS:
                 ControlUpdateSettings(item, kDown);
                 break;
@@ -0,0 +1,160 @@
+#include <ctime>
+
+#include "c2d_helper.h"
+#include "colours.h"
+#include "config.h"
+#include "dir_cache.h"
+#include "fs.h"
+#include "gui.h"
+#include "jobs.h"
+#include "list_view.h"
+#include "textures.h"
+#include "touch.h"
+#include "trash.h"
+#include "unicode.h"
+#include "utils.h"
+
+namespace GUI {
+    static ListView trash_view = { 0.f, 55.f, 320.f, 40.f, 4, 0 };
+    static std::vector<TrashItem> items;
+    static int selection = 0;
+    static std::string message;
+    
+    static void SplitPath(const std::string &path, std::string &parent, std::string &name) {
+        std::size_t pos = path.find_last_of('/');
+        parent = path.substr(0, pos + 1);
+        name = path.substr(pos + 1);
+    }
+    
+    // Anything already waiting to be purged is left out of new purges.
+    static void Purge(const std::vector<TrashItem> &list) {
+        Job job;
+        job.type = JobPurge;
+        job.src_archive = archive;
+        job.dest_archive = archive;
+        job.src_dir = Trash::GetDir();
+        job.dest_dir = Trash::GetDir();
+        
+        for (const TrashItem &trash_item : list) {
+            if (!Jobs::IsBusy(archive, Trash::GetPath(trash_item.id)))
+                job.AddItem(Unicode::ToUTF16(std::to_string(trash_item.id)).c_str(), trash_item.dir);
+        }
+        
+        if (!job.names.empty()) {
+            Jobs::Add(job);
+            message = Jobs::GetTitle(job) + " in the background.";
+        }
+    }
+    
+    static void Restore(MenuItem *item, const TrashItem &trash_item) {
+        std::string parent, name;
+        GUI::SplitPath(trash_item.path, parent, name);
+        
+        if ((Jobs::IsBusy(archive, Trash::GetPath(trash_item.id))) || (Jobs::IsBusy(archive, trash_item.path)))
+            message = "Busy, try again once the jobs have finished.";
+        else if (!FS::DirExists(archive, parent))
+            message = "Its folder no longer exists.";
+        else if (R_FAILED(Trash::Restore(archive, trash_item)))
+            message = "Couldn't restore, something is in its place.";
+        else {
+            message = "Restored " + name + ".";
+            DirCache::Invalidate(archive, parent);
+            DirCache::Invalidate(archive, Trash::GetDir());
+            
+            if (!parent.compare(cfg.cwd)) {
+                FS::GetDirList(cfg.cwd, item->entries);
+                GUI::ResetCheckbox(item);
+            }
+        }
+    }
+    
+    static void DrawTrashItem(const TrashItem &trash_item, float y) {
+        std::string parent, name;
+        GUI::SplitPath(trash_item.path, parent, name);
+        
+        char size[16] = { 0 }, date[32] = { 0 };
+        Utils::GetSizeString(size, static_cast<double>(trash_item.size));
+        
+        const std::time_t time = trash_item.time;
+        std::strftime(date, sizeof(date), "%Y-%m-%d %H:%M", std::localtime(std::addressof(time)));
+        
+        if (name.length() > 36) {
+            name.resize(36);
+            name.append("...");
+        }
+        
+        if (parent.length() > 36) {
+            parent.resize(36);
+            parent.append("...");
+        }
+        
+        float size_width = 0.f, date_width = 0.f;
+        C2D::GetTextSize(0.42f, &size_width, nullptr, size);
+        C2D::GetTextSize(0.42f, &date_width, nullptr, date);
+        
+        C2D::Text(10, y + 3, 0.44f, cfg.dark_theme? WHITE : BLACK, name);
+        C2D::Text(310 - size_width, y + 3, 0.42f, cfg.dark_theme? TITLE_COLOUR_DARK : TITLE_COLOUR, size);
+        C2D::Text(10, y + 19, 0.42f, cfg.dark_theme? TEXT_MIN_COLOUR_DARK : TEXT_MIN_COLOUR_LIGHT, parent);
+        C2D::Text(310 - date_width, y + 19, 0.42f, cfg.dark_theme? TEXT_MIN_COLOUR_DARK : TEXT_MIN_COLOUR_LIGHT, date);
+    }
+    
+    // Everything shown comes from the trash index, the trash itself is never walked.
+    void DisplayTrash(MenuItem *item) {
+        Trash::GetItems(archive, items);
+        Utils::SetBounds(&selection, 0, items.empty()? 0 : items.size() - 1);
+        
+        u64 total = 0;
+        for (const TrashItem &trash_item : items)
+            total += trash_item.size;
+            
+        char size[16] = { 0 };
+        Utils::GetSizeString(size, static_cast<double>(total));
+        
+        C2D::Rect(0, 20, 400, 35, cfg.dark_theme? MENU_BAR_DARK : STATUS_BAR_LIGHT); // Menu bar
+        C2D::Rect(0, 55, 320, 185, cfg.dark_theme? BLACK_BG : WHITE);
+        C2D::Image(icon_back, 5, 25);
+        C2D::Textf(35, 30, 0.44f, WHITE, "Trash - %lu items, %s", static_cast<u32>(items.size()), size);
+        C2D::Text(10, 222, 0.42f, cfg.dark_theme? TEXT_MIN_COLOUR_DARK : TEXT_MIN_COLOUR_LIGHT, 
+            message.empty()? "A: restore  X: delete  Y: empty trash" : message);
+        
+        if (items.empty()) {
+            C2D::Text(10, 63, 0.42f, cfg.dark_theme? WHITE : BLACK, "The trash is empty.");
+            return;
+        }
+        
+        C2D::Rect(0, 55 + ((selection - trash_view.start) * trash_view.row_height), 320, trash_view.row_height, 
+            cfg.dark_theme? SELECTOR_COLOUR_DARK : SELECTOR_COLOUR_LIGHT);
+            
+        GUI::DrawListView(&trash_view, items.size(), [](int i, float y) {
+            GUI::DrawTrashItem(items[i], y);
+        });
+    }
+    
+    void ControlTrash(MenuItem *item, u32 *kDown) {
+        if (*kDown & KEY_DUP)
+            selection--;
+        else if (*kDown & KEY_DDOWN)
+            selection++;
+            
+        int row = GUI::GetTouchedRow(&trash_view, items.size());
+        if ((row != -1) && (*kDown & KEY_TOUCH))
+            selection = row;
+            
+        Utils::SetBounds(&selection, 0, items.empty()? 0 : items.size() - 1);
+        
+        if ((*kDown & KEY_A) && (!items.empty()))
+            GUI::Restore(item, items[selection]);
+        else if ((*kDown & KEY_X) && (!items.empty()))
+            GUI::Purge(std::vector<TrashItem>(1, items[selection]));
+        else if ((*kDown & KEY_Y) && (!items.empty()))
+            GUI::Purge(items);
+        else if ((*kDown & KEY_B) || ((Touch::Rect(5, 25, 30, 50)) && (*kDown & KEY_TOUCH))) {
+            selection = 0;
+            trash_view.start = 0;
+            message.clear();
+            item->state = MENU_STATE_SETTINGS;
+        }
+        
+        GUI::ScrollListView(&trash_view, selection, items.size());
+    }
+}
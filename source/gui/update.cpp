@@ -41,8 +41,13 @@ namespace GUI {
             if (R_FAILED(ret = FSUSER_RenameFile(sdmc_archive, fsMakePath(PATH_ASCII, "/3ds/3DShell/3DShell_UPDATE.3dsx"), sdmc_archive, fsMakePath(PATH_ASCII, __application_path__.c_str()))))
                 Log::Error("FSUSER_RenameFile(update) failed: 0x%x\n", ret);
         }
-        else
+        else {
+            // Left downloaded but not installed if the wait is given up on, the update is offered again.
+            if (!GUI::WaitForJobs())
+                return;
+                
             CIA::InstallUpdate();
+        }
         
         done = true;
     }
@@ -0,0 +1,204 @@
+#include <cstdio>
+#include <jansson.h>
+#include <string>
+
+#include "durability.h"
+#include "fs.h"
+#include "io_tune.h"
+#include "log.h"
+
+#define IO_TUNE_VERSION 1
+
+namespace IOTune {
+    // One entry per (source, destination) pair of SDMC/NAND, indexed by (src * 2) + dest.
+    static const u32 num_directions = 4;
+    static const char *direction_names[num_directions] = { "sdmc_sdmc", "sdmc_nand", "nand_sdmc", "nand_nand" };
+    static const u32 num_candidates = 4;
+    static const u32 candidates[num_candidates] = { 0x10000, 0x20000, 0x40000, 0x80000 };
+    static const u32 default_chunk_size = 0x40000;
+    static const u64 probe_bytes = 0x100000; // measured per candidate before settling
+    static const char *tune_file = "{\n\t\"io_tune_ver\": %d,\n\t\"sdmc_sdmc\": %lu,\n\t\"sdmc_nand\": %lu,\n\t\"nand_sdmc\": %lu,\n\t\"nand_nand\": %lu\n}";
+    static std::string tune_path = "/3ds/3DShell/io_tune.json";
+    
+    typedef struct {
+        u32 chunk_size = 0; // 0 while still probing
+        u64 bytes[num_candidates] = { 0 }; // recorded, short last chunks count for what they moved
+        u64 ticks[num_candidates] = { 0 };
+    } IOTuneState;
+    
+    static IOTuneState states[num_directions];
+    static LightLock lock;
+    static bool dirty = false;
+    
+    // Candidates are probed in order so a pipelined transfer measures runs of equal sized chunks rather than a mix. Each is
+    // handed out until probe_bytes of it have been recorded, not merely requested, so a run of files shorter than the
+    // chunk (each recording less than it asked for) still gets every candidate measured and settles.
+    static u32 GetProbeSize(IOTuneState &state) {
+        for (u32 i = 0; i < num_candidates; i++) {
+            if (state.bytes[i] < probe_bytes)
+                return candidates[i];
+        }
+        
+        // Everything has been measured but Settle() hasn't run yet, use the best measured so far.
+        u32 best = default_chunk_size;
+        u64 best_rate = 0;
+        for (u32 i = 0; i < num_candidates; i++) {
+            u64 rate = state.ticks[i] > 0? (state.bytes[i] * SYSCLOCK_ARM11) / state.ticks[i] : 0;
+            if (rate > best_rate) {
+                best = candidates[i];
+                best_rate = rate;
+            }
+        }
+        
+        return best;
+    }
+    
+    static void Settle(u32 direction) {
+        IOTuneState &state = states[direction];
+        u32 best = 0;
+        u64 best_rate = 0;
+        
+        for (u32 i = 0; i < num_candidates; i++) {
+            if (state.bytes[i] < probe_bytes)
+                return;
+                
+            u64 rate = (state.bytes[i] * SYSCLOCK_ARM11) / (state.ticks[i] > 0? state.ticks[i] : 1);
+            Log::Debug("IOTune(%s): 0x%lx -> %.2f MB/s\n", direction_names[direction], candidates[i], static_cast<double>(rate) / (1024.0 * 1024.0));
+            
+            if (rate > best_rate) {
+                best = i;
+                best_rate = rate;
+            }
+        }
+        
+        state.chunk_size = candidates[best];
+        dirty = true;
+        Log::Debug("IOTune(%s): settled on 0x%lx\n", direction_names[direction], state.chunk_size);
+    }
+    
+    static bool IsCandidate(u32 chunk_size) {
+        for (u32 i = 0; i < num_candidates; i++) {
+            if (candidates[i] == chunk_size)
+                return true;
+        }
+        
+        return false;
+    }
+    
+    int Save(void) {
+        LightLock_Lock(&lock);
+        if (!dirty) {
+            LightLock_Unlock(&lock);
+            return 0;
+        }
+        
+        char buf[256];
+        u32 length = std::snprintf(buf, sizeof(buf), tune_file, IO_TUNE_VERSION, states[0].chunk_size, states[1].chunk_size, 
+            states[2].chunk_size, states[3].chunk_size);
+        dirty = false;
+        LightLock_Unlock(&lock);
+        
+        Result ret = 0;
+        FSUSER_DeleteFile(sdmc_archive, fsMakePath(PATH_ASCII, tune_path.c_str()));
+        FSUSER_CreateFile(sdmc_archive, fsMakePath(PATH_ASCII, tune_path.c_str()), 0, length);
+        
+        Handle file;
+        if (R_FAILED(ret = FSUSER_OpenFile(&file, sdmc_archive, fsMakePath(PATH_ASCII, tune_path.c_str()), FS_OPEN_WRITE, 0))) {
+            Log::Error("FSUSER_OpenFile(/3ds/3DShell/io_tune.json) failed: 0x%x\n", ret);
+            return ret;
+        }
+        
+        u32 bytes_written = 0;
+        if (R_FAILED(ret = FSFILE_Write(file, &bytes_written, 0, buf, length, Durability::GetWriteFlags(DurabilityState)))) {
+            Log::Error("FSFILE_Write(/3ds/3DShell/io_tune.json) failed: 0x%x\n", ret);
+            FSFILE_Close(file);
+            return ret;
+        }
+        
+        Durability::Close(DurabilityState, file);
+        return 0;
+    }
+    
+    // Learned sizes are optional, anything missing or unrecognised is simply probed again.
+    int Load(void) {
+        Result ret = 0;
+        LightLock_Init(&lock);
+        
+        if (!FS::FileExists(sdmc_archive, tune_path))
+            return 0;
+            
+        Handle file;
+        if (R_FAILED(ret = FSUSER_OpenFile(&file, sdmc_archive, fsMakePath(PATH_ASCII, tune_path.c_str()), FS_OPEN_READ, 0)))
+            return ret;
+            
+        u64 size = 0;
+        if (R_FAILED(ret = FSFILE_GetSize(file, &size))) {
+            FSFILE_Close(file);
+            return ret;
+        }
+        
+        char *buf = new char[size + 1];
+        u32 bytes_read = 0;
+        
+        if (R_FAILED(ret = FSFILE_Read(file, &bytes_read, 0, buf, size))) {
+            FSFILE_Close(file);
+            delete[] buf;
+            return ret;
+        }
+        
+        FSFILE_Close(file);
+        buf[bytes_read] = '\0';
+        
+        json_error_t error;
+        json_t *root = json_loads(buf, JSON_DISABLE_EOF_CHECK, &error);
+        delete[] buf;
+        
+        if (!root) {
+            Log::Error("Failed to decode io_tune.json!\n");
+            return -1;
+        }
+        
+        if (json_integer_value(json_object_get(root, "io_tune_ver")) == IO_TUNE_VERSION) {
+            for (u32 i = 0; i < num_directions; i++) {
+                u32 chunk_size = json_integer_value(json_object_get(root, direction_names[i]));
+                if (IOTune::IsCandidate(chunk_size))
+                    states[i].chunk_size = chunk_size;
+            }
+        }
+        
+        json_decref(root);
+        return 0;
+    }
+    
+    u32 GetDirection(FS_Archive src, FS_Archive dest) {
+        return ((src == nand_archive? 1 : 0) * 2) + (dest == nand_archive? 1 : 0);
+    }
+    
+    u32 GetChunkSize(u32 direction) {
+        LightLock_Lock(&lock);
+        IOTuneState &state = states[direction];
+        u32 size = state.chunk_size? state.chunk_size : IOTune::GetProbeSize(state);
+        LightLock_Unlock(&lock);
+        return size;
+    }
+    
+    // Reports how long a chunk of chunk_size took, bytes may be short for the last chunk of a file.
+    void Record(u32 direction, u32 chunk_size, u32 bytes, u64 ticks) {
+        LightLock_Lock(&lock);
+        IOTuneState &state = states[direction];
+        
+        if (state.chunk_size == 0) {
+            for (u32 i = 0; i < num_candidates; i++) {
+                if (candidates[i] == chunk_size) {
+                    state.bytes[i] += bytes;
+                    state.ticks[i] += ticks;
+                    break;
+                }
+            }
+            
+            IOTune::Settle(direction);
+        }
+        
+        LightLock_Unlock(&lock);
+    }
+}
@@ -0,0 +1,550 @@
+#include <algorithm>
+#include <filesystem>
+
+#include "archive_helper.h"
+#include "dir_cache.h"
+#include "durability.h"
+#include "fs.h"
+#include "io_tune.h"
+#include "jobs.h"
+#include "journal.h"
+#include "log.h"
+#include "trash.h"
+#include "undo.h"
+#include "unicode.h"
+
+void Job::AddItem(const char16_t *name, bool dir) {
+    names.push_back(name);
+    dirs.push_back(dir);
+}
+
+// Copy, move, delete and extraction run here on a worker thread so the browser stays usable. Jobs run one at a time, in
+// queue order, except that a job held back by the user lets later ones past as long as they don't touch its paths. So
+// anything that reads or writes a path another job is still writing always runs after it. Purging the trash is never
+// urgent, it waits for every other runnable job and runs at the lowest priority.
+namespace Jobs {
+    typedef struct {
+        FS_Archive archive = 0;
+        std::string path; // no trailing '/'
+        bool write = false;
+    } JobPath;
+    
+    static const u32 max_finished = 16;
+    static const std::string log_path = "/3ds/3DShell/debug.log";
+    
+    static Thread thread = nullptr;
+    static LightLock lock;
+    static LightSemaphore wake;
+    static std::vector<Job> jobs;
+    static u32 next_id = 1;
+    static u32 running_id = 0;
+    static bool quit = false;
+    
+    static const char *GetVerb(JobType type) {
+        switch (type) {
+            case JobCopy:
+                return "Copying";
+            case JobMove:
+                return "Moving";
+            case JobDelete:
+                return "Deleting";
+            case JobExtract:
+                return "Extracting";
+            case JobTrash:
+                return "Trashing";
+            case JobPurge:
+                return "Purging";
+        }
+        
+        return "";
+    }
+    
+    std::string GetTitle(const Job &job) {
+        std::string title = Jobs::GetVerb(job.type);
+        
+        if (job.type == JobPurge)
+            title.append(" " + std::to_string(job.names.size()) + (job.names.size() == 1? " item" : " items"));
+        else if (job.names.size() == 1)
+            title.append(" " + Unicode::ToUTF8(job.names[0]));
+        else
+            title.append(" " + std::to_string(job.names.size()) + " items");
+            
+        return title;
+    }
+    
+    static void GetPaths(const Job &job, std::vector<JobPath> &paths) {
+        for (u32 i = 0; i < job.names.size(); i++) {
+            std::string name = Unicode::ToUTF8(job.names[i]);
+            JobPath src = { job.src_archive, job.src_dir + name, job.type != JobCopy };
+            
+            if (job.type == JobExtract)
+                src.write = false;
+                
+            paths.push_back(src);
+            
+            if ((job.type == JobCopy) || (job.type == JobMove)) {
+                JobPath dest = { job.dest_archive, job.dest_dir + Unicode::ToUTF8(job.GetDestName(i)), true };
+                paths.push_back(dest);
+            }
+            else if (job.type == JobExtract) {
+                JobPath dest = { job.dest_archive, job.dest_dir + std::filesystem::path(name).stem().string(), true };
+                paths.push_back(dest);
+            }
+        }
+        
+        if (job.type == JobTrash) {
+            JobPath dest = { job.dest_archive, job.dest_dir.substr(0, job.dest_dir.length() - 1), true };
+            paths.push_back(dest);
+        }
+    }
+    
+    static bool IsWithin(const std::string &path, const std::string &parent) {
+        return ((path.length() >= parent.length()) && (!path.compare(0, parent.length(), parent)) && 
+            ((path.length() == parent.length()) || (path[parent.length()] == '/') || (parent.back() == '/')));
+    }
+    
+    static bool Overlaps(const JobPath &a, const JobPath &b) {
+        return ((a.archive == b.archive) && ((Jobs::IsWithin(a.path, b.path)) || (Jobs::IsWithin(b.path, a.path))));
+    }
+    
+    // Two jobs conflict when either one writes somewhere the other touches.
+    static bool Conflicts(const Job &a, const Job &b) {
+        std::vector<JobPath> a_paths, b_paths;
+        Jobs::GetPaths(a, a_paths);
+        Jobs::GetPaths(b, b_paths);
+        
+        for (const JobPath &a_path : a_paths) {
+            for (const JobPath &b_path : b_paths) {
+                if (((a_path.write) || (b_path.write)) && (Jobs::Overlaps(a_path, b_path)))
+                    return true;
+            }
+        }
+        
+        return false;
+    }
+    
+    // Returns the index of the next job to run, or -1. Purges only once nothing else can run. Called with the lock held.
+    static int GetNextJob(void) {
+        int purge = -1;
+        
+        for (u32 i = 0; i < jobs.size(); i++) {
+            if ((jobs[i].state != JobQueued) || (jobs[i].held))
+                continue;
+                
+            bool blocked = false;
+            for (u32 j = 0; (j < i) && (!blocked); j++)
+                blocked = (!jobs[j].IsFinished()) && (Jobs::Conflicts(jobs[j], jobs[i]));
+                
+            if (blocked)
+                continue;
+            else if (jobs[i].type != JobPurge)
+                return i;
+            else if (purge == -1)
+                purge = i;
+        }
+        
+        return purge;
+    }
+    
+    static Job *Find(u32 id) {
+        auto it = std::find_if(jobs.begin(), jobs.end(), [id](const Job &job) { return job.id == id; });
+        return it != jobs.end()? &(*it) : nullptr;
+    }
+    
+    static bool Exists(FS_Archive archive, const std::string &path, bool dir) {
+        return dir? FS::DirExists(archive, path) : FS::FileExists(archive, path);
+    }
+    
+    // For a moved or trashed item, how to put it back. trash_id is where it went in the trash.
+    static UndoEntry GetUndoEntry(const Job &job, u32 index, u32 trash_id) {
+        std::string name = Unicode::ToUTF8(job.names[index]);
+        UndoEntry entry;
+        entry.type = job.type == JobTrash? UndoTrash : UndoMove;
+        entry.src_archive = job.src_archive;
+        entry.dest_archive = job.dest_archive;
+        entry.dir = job.dirs[index];
+        entry.id = trash_id;
+        entry.src = job.src_dir + name;
+        entry.dest = job.type == JobTrash? Trash::GetPath(trash_id) : job.dest_dir + Unicode::ToUTF8(job.GetDestName(index));
+        return entry;
+    }
+    
+    static Result RunItem(const Job &job, u32 index, u32 *trash_id) {
+        std::u16string src = Unicode::ToUTF16(job.src_dir) + job.names[index];
+        std::u16string dest = Unicode::ToUTF16(job.dest_dir) + job.GetDestName(index);
+        Result ret = 0;
+        
+        switch (job.type) {
+            case JobCopy:
+                return FS::CopyTree(job.src_archive, src, job.dest_archive, dest, job.dirs[index], job.conflict);
+                
+            case JobMove:
+                // A resumed move may have been cut short right after finishing its first item.
+                if ((job.resume) && (index == 0) && (!Jobs::Exists(job.src_archive, job.src_dir + Unicode::ToUTF8(job.names[index]), job.dirs[index])) && 
+                    (Jobs::Exists(job.dest_archive, job.dest_dir + Unicode::ToUTF8(job.GetDestName(index)), job.dirs[index]))) {
+                    Progress::ItemDone(0);
+                    return 0;
+                }
+                
+                // Across archives the move is a copy, which counts its own files.
+                if (job.src_archive != job.dest_archive)
+                    return FS::MoveTree(job.src_archive, src, job.dest_archive, dest, job.dirs[index], job.conflict);
+                    
+                Progress::SetItem(Unicode::ToUTF8(job.names[index]), 0);
+                ret = FS::MoveTree(job.src_archive, src, job.dest_archive, dest, job.dirs[index], job.conflict);
+                Progress::ItemDone(ret);
+                return ret;
+                
+            case JobDelete:
+            case JobTrash: {
+                // The log can't be deleted (or have its folder deleted or moved) while it is open.
+                bool log = (job.src_archive == sdmc_archive) && (Jobs::IsWithin(log_path, Unicode::ToUTF8(src)));
+                if (log)
+                    Log::Close();
+                    
+                if (job.type == JobTrash) {
+                    Progress::SetItem(Unicode::ToUTF8(job.names[index]), 0);
+                    ret = Trash::Add(job.src_archive, Unicode::ToUTF8(src), job.dirs[index], trash_id);
+                    Progress::ItemDone(ret);
+                }
+                else
+                    ret = FS::DeleteTree(job.src_archive, src, job.dirs[index]);
+                    
+                if (log)
+                    Log::Open();
+                    
+                return ret;
+            }
+            
+            case JobExtract:
+                return ArchiveHelper::Extract(job.dest_archive, Unicode::ToUTF8(src), job.dest_dir, job.conflict);
+                
+            case JobPurge:
+                // Only forgotten by the index once it's completely gone, a cancelled purge leaves the rest in the trash.
+                if ((R_SUCCEEDED(ret = FS::DeleteTree(job.src_archive, src, job.dirs[index]))) && (!Progress::IsCancelled()))
+                    Trash::Remove(job.src_archive, std::stoul(Unicode::ToUTF8(job.names[index])));
+                    
+                return ret;
+        }
+        
+        return 0;
+    }
+    
+    // An item kept alongside whatever is already at the destination gets its free name as the job starts, so it's
+    // journaled with the job and a resumed job carries on into the same place.
+    static void ResolveNames(Job &job) {
+        job.dest_names.clear();
+        
+        for (u32 i = 0; i < job.names.size(); i++)
+            job.dest_names.push_back(Conflict::GetFreeName(job.dest_archive, job.dest_dir, job.names[i], job.dirs[i]));
+    }
+    
+    static bool IsJournaled(const Job &job) {
+        return (job.type == JobCopy) || (job.type == JobMove);
+    }
+    
+    static Result Run(const Job &job) {
+        Result ret = 0, item_ret = 0;
+        
+        if (((job.type == JobMove) && (job.src_archive == job.dest_archive)) || (job.type == JobTrash))
+            Progress::AddTotal(0, job.names.size());
+            
+        if (Jobs::IsJournaled(job))
+            Journal::Begin(job);
+            
+        // Whatever was moved or trashed is recorded for undo as one step, however far the job got.
+        std::vector<UndoEntry> undo;
+        bool undoable = ((job.type == JobMove) && (!job.undoing)) || (job.type == JobTrash);
+        
+        for (u32 i = 0; (i < job.names.size()) && (!Progress::IsCancelled()); i++) {
+            u32 trash_id = 0;
+            Journal::SetItem(i);
+            
+            if (R_FAILED(item_ret = Jobs::RunItem(job, i, &trash_id))) {
+                if (R_SUCCEEDED(ret))
+                    ret = item_ret;
+            }
+            else if ((undoable) && (!Progress::IsCancelled()))
+                undo.push_back(Jobs::GetUndoEntry(job, i, trash_id));
+        }
+        
+        Undo::Record(undo);
+        return ret;
+    }
+    
+    // Queues a purge of the oldest trash on archive when it's running out of space, unless one is already on its way.
+    static void QueueAutoPurge(FS_Archive archive) {
+        LightLock_Lock(&lock);
+        bool queued = std::any_of(jobs.begin(), jobs.end(), [archive](const Job &job) {
+            return ((job.type == JobPurge) && (job.src_archive == archive) && (!job.IsFinished()));
+        });
+        LightLock_Unlock(&lock);
+        
+        std::vector<TrashItem> items;
+        if ((queued) || (!Trash::GetPurgeList(archive, items)))
+            return;
+            
+        Job job;
+        job.type = JobPurge;
+        job.src_archive = archive;
+        job.dest_archive = archive;
+        job.src_dir = Trash::GetDir();
+        job.dest_dir = Trash::GetDir();
+        
+        for (const TrashItem &item : items)
+            job.AddItem(Unicode::ToUTF16(std::to_string(item.id)).c_str(), item.dir);
+            
+        Log::Debug("Low on space, purging %lu trash items\n", static_cast<u32>(items.size()));
+        Jobs::Add(job);
+    }
+    
+    // Sits just below the UI thread, the copy engine's own threads (created relative to this one) end up level with it.
+    static void WorkerThread(void *args) {
+        while (true) {
+            LightLock_Lock(&lock);
+            
+            if (quit) {
+                LightLock_Unlock(&lock);
+                break;
+            }
+            
+            int index = Jobs::GetNextJob();
+            if (index == -1) {
+                LightLock_Unlock(&lock);
+                LightSemaphore_Acquire(&wake, 1);
+                continue;
+            }
+            
+            jobs[index].state = JobRunning;
+            running_id = jobs[index].id;
+            Job job = jobs[index];
+            Progress::Start(Jobs::GetVerb(job.type), false);
+            
+            if ((job.type == JobCopy) || (job.type == JobMove) || (job.type == JobExtract))
+                Progress::SetDurability(Durability::GetMode(DurabilityCopy));
+                
+            LightLock_Unlock(&lock);
+            
+            s32 prio = 0;
+            svcGetThreadPriority(&prio, CUR_THREAD_HANDLE);
+            
+            if (job.type == JobPurge)
+                svcSetThreadPriority(CUR_THREAD_HANDLE, 0x3F);
+            else if ((job.conflict == ConflictRename) && (!job.resume) && ((job.type == JobCopy) || (job.type == JobMove))) {
+                Jobs::ResolveNames(job);
+                
+                // Stored before the job runs so IsBusy sees the names it writes to while it is still writing them.
+                LightLock_Lock(&lock);
+                Job *queued = Jobs::Find(job.id);
+                if (queued)
+                    queued->dest_names = job.dest_names;
+                    
+                LightLock_Unlock(&lock);
+            }
+            
+            Result ret = Jobs::Run(job);
+            
+            if (job.type == JobPurge)
+                svcSetThreadPriority(CUR_THREAD_HANDLE, prio);
+                
+            LightLock_Lock(&lock);
+            
+            // A job only cut short by the app exiting is left in the journal to be resumed on the next launch.
+            Journal::End((quit) && (Progress::IsCancelled()));
+            Progress::End();
+            
+            Job *current = Jobs::Find(job.id);
+            if (current) {
+                Progress::GetInfo(&current->info);
+                current->result = ret;
+                current->state = current->info.cancelled? JobCancelled : (R_FAILED(ret) || (current->info.failed > 0))? JobFailed : JobDone;
+            }
+            
+            running_id = 0;
+            LightLock_Unlock(&lock);
+            IOTune::Save();
+            Undo::Flush();
+            Log::Flush();
+            
+            if ((!quit) && ((job.type == JobCopy) || (job.type == JobMove) || (job.type == JobExtract)))
+                Jobs::QueueAutoPurge(job.dest_archive);
+        }
+    }
+    
+    void Init(void) {
+        LightLock_Init(&lock);
+        LightSemaphore_Init(&wake, 0, 0x7FFF);
+        quit = false;
+        
+        s32 prio = 0;
+        svcGetThreadPriority(&prio, CUR_THREAD_HANDLE);
+        
+        if (!(thread = threadCreate(Jobs::WorkerThread, nullptr, 64 * 1024, prio + 1, -2, false))) {
+            Log::Error("threadCreate(WorkerThread) failed\n");
+            return;
+        }
+        
+        Jobs::QueueAutoPurge(sdmc_archive);
+        Jobs::QueueAutoPurge(nand_archive);
+    }
+    
+    void Exit(void) {
+        if (!thread)
+            return;
+            
+        LightLock_Lock(&lock);
+        quit = true;
+        
+        if (running_id != 0)
+            Progress::Cancel();
+            
+        LightLock_Unlock(&lock);
+        LightSemaphore_Release(&wake, 1);
+        threadJoin(thread, U64_MAX);
+        threadFree(thread);
+        thread = nullptr;
+    }
+    
+    u32 Add(const Job &job) {
+        LightLock_Lock(&lock);
+        
+        // Finished jobs are only kept around for the panel, the oldest are dropped once there are too many.
+        u32 finished = std::count_if(jobs.begin(), jobs.end(), [](const Job &job) { return ((job.IsFinished()) && (job.handled)); });
+        for (auto it = jobs.begin(); (it != jobs.end()) && (finished >= max_finished);) {
+            if ((it->IsFinished()) && (it->handled)) {
+                it = jobs.erase(it);
+                finished--;
+            }
+            else
+                ++it;
+        }
+        
+        jobs.push_back(job);
+        Job &added = jobs.back();
+        added.id = next_id++;
+        added.state = JobQueued;
+        added.info.title = Jobs::GetVerb(added.type);
+        u32 id = added.id;
+        
+        LightLock_Unlock(&lock);
+        LightSemaphore_Release(&wake, 1);
+        return id;
+    }
+    
+    void Pause(u32 id) {
+        LightLock_Lock(&lock);
+        Job *job = Jobs::Find(id);
+        
+        if ((job) && (job->state == JobRunning)) {
+            Progress::SetPaused(true);
+            job->state = JobPaused;
+        }
+        else if ((job) && (job->state == JobQueued))
+            job->held = true;
+            
+        LightLock_Unlock(&lock);
+    }
+    
+    void Resume(u32 id) {
+        LightLock_Lock(&lock);
+        Job *job = Jobs::Find(id);
+        
+        if ((job) && (job->state == JobPaused)) {
+            Progress::SetPaused(false);
+            job->state = JobRunning;
+        }
+        else if (job)
+            job->held = false;
+            
+        LightLock_Unlock(&lock);
+        LightSemaphore_Release(&wake, 1);
+    }
+    
+    void Cancel(u32 id) {
+        LightLock_Lock(&lock);
+        Job *job = Jobs::Find(id);
+        
+        if ((job) && ((job->state == JobRunning) || (job->state == JobPaused)))
+            Progress::Cancel();
+        else if ((job) && (job->state == JobQueued)) {
+            job->state = JobCancelled;
+            job->info.cancelled = true;
+        }
+        
+        LightLock_Unlock(&lock);
+        LightSemaphore_Release(&wake, 1);
+    }
+    
+    void ClearFinished(void) {
+        LightLock_Lock(&lock);
+        jobs.erase(std::remove_if(jobs.begin(), jobs.end(), [](const Job &job) { return ((job.IsFinished()) && (job.handled)); }), jobs.end());
+        LightLock_Unlock(&lock);
+    }
+    
+    void GetJobs(std::vector<Job> &list) {
+        LightLock_Lock(&lock);
+        list = jobs;
+        
+        for (Job &job : list) {
+            if (job.id == running_id)
+                Progress::GetInfo(&job.info);
+        }
+        
+        LightLock_Unlock(&lock);
+    }
+    
+    u32 GetActiveCount(void) {
+        LightLock_Lock(&lock);
+        u32 count = std::count_if(jobs.begin(), jobs.end(), [](const Job &job) { return !job.IsFinished(); });
+        LightLock_Unlock(&lock);
+        return count;
+    }
+    
+    // Whether an unfinished job touches path, or anything inside it or containing it.
+    bool IsBusy(FS_Archive archive, const std::string &path) {
+        JobPath busy = { archive, path, true };
+        bool ret = false;
+        
+        LightLock_Lock(&lock);
+        for (u32 i = 0; (i < jobs.size()) && (!ret); i++) {
+            if (jobs[i].IsFinished())
+                continue;
+                
+            std::vector<JobPath> paths;
+            Jobs::GetPaths(jobs[i], paths);
+            ret = std::any_of(paths.begin(), paths.end(), [&busy](const JobPath &job_path) { return Jobs::Overlaps(job_path, busy); });
+        }
+        
+        LightLock_Unlock(&lock);
+        return ret;
+    }
+    
+    // Called from the UI thread every frame. The listing cache isn't thread safe, so the listings a job touched are
+    // only invalidated here once it has finished. Returns whether the listing of cwd on archive needs reading again.
+    bool Update(FS_Archive archive, const std::string &cwd) {
+        bool refresh = false;
+        LightLock_Lock(&lock);
+        
+        for (Job &job : jobs) {
+            if ((!job.IsFinished()) || (job.handled))
+                continue;
+                
+            std::vector<JobPath> paths;
+            Jobs::GetPaths(job, paths);
+            
+            DirCache::Invalidate(job.src_archive, job.src_dir);
+            DirCache::Invalidate(job.dest_archive, job.dest_dir);
+            
+            for (const JobPath &path : paths) {
+                if (path.write)
+                    DirCache::InvalidateTree(path.archive, path.path + "/");
+            }
+            
+            refresh |= ((job.src_archive == archive) && (!job.src_dir.compare(cwd))) || ((job.dest_archive == archive) && (!job.dest_dir.compare(cwd)));
+            job.handled = true;
+        }
+        
+        LightLock_Unlock(&lock);
+        return refresh;
+    }
+}
@@ -0,0 +1,393 @@
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "durability.h"
+#include "fs.h"
+#include "journal.h"
+#include "log.h"
+#include "unicode.h"
+
+// A copy or move keeps a journal of its job, the manifest of the item in progress and how far each of that item's files
+// got. An offset is only recorded once everything below it has been flushed to the destination, so after a crash (or
+// the battery running out) the job can be picked up from the last recorded chunk instead of starting over.
+namespace Journal {
+    static const u32 journal_magic = 0x4C4E524A; // "JRNL"
+    static const u32 journal_version = 2;
+    static const u64 complete = ~0ULL;
+    static const u64 skipped = ~1ULL; // left as the destination had it
+    static const char *journal_path = "/3ds/3DShell/transfer.journal";
+    
+    // Followed by the strings (src_dir, dest_dir, every item name then every item's destination name, each null
+    // terminated), a u8 per item marking
+    // directories, the manifest (path pool, path offsets, sizes, directory flags) and finally, 8 byte aligned at
+    // table_offset, one u64 per manifest entry holding the bytes committed so far.
+    typedef struct {
+        u32 magic = 0;
+        u32 version = 0;
+        u32 type = 0;
+        u32 src_archive = 0; // 0 = sdmc, 1 = nand
+        u32 dest_archive = 0;
+        u32 item = 0;
+        u32 conflict = 0; // ConflictPolicy
+        u32 num_items = 0;
+        u32 strings_length = 0; // char16_t units
+        u32 num_entries = 0;
+        u32 paths_length = 0; // char16_t units
+        u32 table_offset = 0;
+        u32 length = 0;
+    } JournalHeader;
+    
+    static Handle handle = 0;
+    static bool active = false;
+    static JournalHeader header;
+    static Job job;
+    static std::vector<u64> committed;
+    static u32 dirty_first = 0, dirty_last = 0;
+    static bool dirty = false;
+    static s32 file = -1;
+    
+    // Left by Load() for the first item of the resumed job.
+    static TreeManifest resume_manifest;
+    static bool resume = false;
+    
+    static u32 GetArchiveIndex(FS_Archive archive) {
+        return archive == nand_archive? 1 : 0;
+    }
+    
+    static void Append(std::vector<u8> &buf, const void *data, u32 size) {
+        const u8 *bytes = static_cast<const u8 *>(data);
+        buf.insert(buf.end(), bytes, bytes + size);
+    }
+    
+    static void AppendString(std::vector<u8> &buf, const std::u16string &str) {
+        Journal::Append(buf, str.c_str(), (str.length() + 1) * sizeof(char16_t));
+    }
+    
+    static void Reset(void) {
+        committed.clear();
+        resume_manifest.Clear();
+        resume = false;
+        dirty = false;
+        file = -1;
+    }
+    
+    // Rewrites the whole journal, manifest is the item in progress (nullptr when it has none).
+    static void Write(const TreeManifest *manifest) {
+        std::vector<u8> strings;
+        Journal::AppendString(strings, Unicode::ToUTF16(job.src_dir));
+        Journal::AppendString(strings, Unicode::ToUTF16(job.dest_dir));
+        
+        for (const std::u16string &name : job.names)
+            Journal::AppendString(strings, name);
+            
+        for (u32 i = 0; i < job.names.size(); i++)
+            Journal::AppendString(strings, job.GetDestName(i));
+            
+        header.magic = journal_magic;
+        header.version = journal_version;
+        header.num_items = job.names.size();
+        header.strings_length = strings.size() / sizeof(char16_t);
+        header.num_entries = manifest? manifest->Size() : 0;
+        header.paths_length = manifest? manifest->paths.size() : 0;
+        
+        std::vector<u8> buf;
+        buf.reserve(sizeof(JournalHeader) + strings.size() + (manifest? (manifest->paths.size() * 2) + (manifest->Size() * 21) : 0));
+        Journal::Append(buf, &header, sizeof(JournalHeader));
+        buf.insert(buf.end(), strings.begin(), strings.end());
+        buf.insert(buf.end(), job.dirs.begin(), job.dirs.end());
+        
+        if (manifest) {
+            Journal::Append(buf, manifest->paths.data(), manifest->paths.size() * sizeof(char16_t));
+            Journal::Append(buf, manifest->path_offsets.data(), manifest->Size() * sizeof(u32));
+            Journal::Append(buf, manifest->sizes.data(), manifest->Size() * sizeof(u64));
+            Journal::Append(buf, manifest->dirs.data(), manifest->Size());
+        }
+        
+        buf.resize((buf.size() + 7) & ~7);
+        u32 table_offset = buf.size();
+        Journal::Append(buf, committed.data(), committed.size() * sizeof(u64));
+        
+        JournalHeader *buf_header = reinterpret_cast<JournalHeader *>(buf.data());
+        buf_header->table_offset = header.table_offset = table_offset;
+        buf_header->length = header.length = buf.size();
+        
+        Result ret = 0;
+        u32 bytes_written = 0;
+        if (R_FAILED(ret = FSFILE_Write(handle, &bytes_written, 0, buf.data(), buf.size(), Durability::GetWriteFlags(DurabilityState))))
+            Log::Error("FSFILE_Write(%s) failed: 0x%x\n", journal_path, ret);
+        else if (R_FAILED(ret = FSFILE_SetSize(handle, buf.size())))
+            Log::Error("FSFILE_SetSize(%s) failed: 0x%x\n", journal_path, ret);
+            
+        dirty = false;
+    }
+    
+    static bool Read(const std::vector<u8> &buf, Job &loaded) {
+        if (buf.size() < sizeof(JournalHeader))
+            return false;
+            
+        std::memcpy(&header, buf.data(), sizeof(JournalHeader));
+        if ((header.magic != journal_magic) || (header.version != journal_version) || (header.length != buf.size()) || 
+            (header.item >= header.num_items) || (header.type > JobExtract))
+            return false;
+            
+        u64 strings_end = sizeof(JournalHeader) + (static_cast<u64>(header.strings_length) * sizeof(char16_t));
+        u64 manifest_end = strings_end + header.num_items + (static_cast<u64>(header.paths_length) * sizeof(char16_t)) + 
+            (static_cast<u64>(header.num_entries) * (sizeof(u32) + sizeof(u64) + 1));
+            
+        if ((manifest_end > header.table_offset) || (header.table_offset + (static_cast<u64>(header.num_entries) * sizeof(u64)) != header.length))
+            return false;
+            
+        // The strings are null terminated one after the other, there should be exactly two plus two per item.
+        std::vector<std::u16string> strings;
+        std::u16string str;
+        
+        for (u32 i = 0; i < header.strings_length; i++) {
+            char16_t c = 0;
+            std::memcpy(&c, &buf[sizeof(JournalHeader) + (i * sizeof(char16_t))], sizeof(char16_t));
+            
+            if (c == u'\0') {
+                strings.push_back(str);
+                str.clear();
+            }
+            else
+                str.push_back(c);
+        }
+        
+        if (strings.size() != (header.num_items * 2) + 2)
+            return false;
+            
+        loaded = Job();
+        loaded.type = static_cast<JobType>(header.type);
+        loaded.src_archive = header.src_archive == 1? nand_archive : sdmc_archive;
+        loaded.dest_archive = header.dest_archive == 1? nand_archive : sdmc_archive;
+        loaded.src_dir = Unicode::ToUTF8(strings[0]);
+        loaded.dest_dir = Unicode::ToUTF8(strings[1]);
+        loaded.conflict = static_cast<ConflictPolicy>(header.conflict);
+        
+        // Items before the one in progress are finished, the resumed job starts from it.
+        u32 offset = strings_end;
+        for (u32 i = 0; i < header.num_items; i++) {
+            if (i >= header.item) {
+                loaded.AddItem(strings[i + 2].c_str(), buf[offset + i]);
+                loaded.dest_names.push_back(strings[i + 2 + header.num_items]);
+            }
+        }
+        
+        offset += header.num_items;
+        resume_manifest.Clear();
+        resume_manifest.paths.resize(header.paths_length);
+        resume_manifest.path_offsets.resize(header.num_entries);
+        resume_manifest.sizes.resize(header.num_entries);
+        resume_manifest.dirs.resize(header.num_entries);
+        committed.resize(header.num_entries);
+        
+        std::memcpy(resume_manifest.paths.data(), &buf[offset], header.paths_length * sizeof(char16_t));
+        offset += header.paths_length * sizeof(char16_t);
+        std::memcpy(resume_manifest.path_offsets.data(), &buf[offset], header.num_entries * sizeof(u32));
+        offset += header.num_entries * sizeof(u32);
+        std::memcpy(resume_manifest.sizes.data(), &buf[offset], header.num_entries * sizeof(u64));
+        offset += header.num_entries * sizeof(u64);
+        std::memcpy(resume_manifest.dirs.data(), &buf[offset], header.num_entries);
+        std::memcpy(committed.data(), &buf[header.table_offset], header.num_entries * sizeof(u64));
+        
+        for (u32 i = 0; i < header.num_entries; i++) {
+            if ((resume_manifest.path_offsets[i] >= header.paths_length) || ((i > 0) && (resume_manifest.path_offsets[i] <= resume_manifest.path_offsets[i - 1])))
+                return false;
+                
+            if (resume_manifest.dirs[i])
+                resume_manifest.num_dirs++;
+            else {
+                resume_manifest.num_files++;
+                resume_manifest.total_bytes += resume_manifest.sizes[i];
+            }
+        }
+        
+        if ((header.paths_length > 0) && (resume_manifest.paths.back() != u'\0'))
+            return false;
+            
+        resume = header.num_entries > 0;
+        return true;
+    }
+    
+    // Reads the journal left by a job that never finished into job. Called once at start up, before any job runs.
+    bool Load(Job &loaded) {
+        Result ret = 0;
+        Handle file_handle;
+        
+        if (R_FAILED(ret = FSUSER_OpenFile(&file_handle, sdmc_archive, fsMakePath(PATH_ASCII, journal_path), FS_OPEN_READ, 0)))
+            return false;
+            
+        u64 size = 0;
+        std::vector<u8> buf;
+        
+        if (R_SUCCEEDED(ret = FSFILE_GetSize(file_handle, &size)) && (size <= 0x4000000)) {
+            u32 bytes_read = 0;
+            buf.resize(size);
+            
+            if ((R_FAILED(ret = FSFILE_Read(file_handle, &bytes_read, 0, buf.data(), size))) || (bytes_read != size))
+                buf.clear();
+        }
+        
+        FSFILE_Close(file_handle);
+        
+        if (!Journal::Read(buf, loaded)) {
+            Log::Error("Journal::Load: %s is damaged, discarding it\n", journal_path);
+            Journal::Discard();
+            return false;
+        }
+        
+        Log::Debug("Journal::Load: %lu items left, item 0 has %lu entries\n", static_cast<u32>(loaded.names.size()), header.num_entries);
+        return true;
+    }
+    
+    void Discard(void) {
+        Journal::Reset();
+        FSUSER_DeleteFile(sdmc_archive, fsMakePath(PATH_ASCII, journal_path));
+    }
+    
+    // Starts journaling job on the worker thread. A resumed job keeps the manifest and offsets Load() left for its first item.
+    void Begin(const Job &current) {
+        Result ret = 0;
+        
+        if (!current.resume)
+            Journal::Reset();
+            
+        FSUSER_CreateFile(sdmc_archive, fsMakePath(PATH_ASCII, journal_path), 0, 0);
+        if (R_FAILED(ret = FSUSER_OpenFile(&handle, sdmc_archive, fsMakePath(PATH_ASCII, journal_path), FS_OPEN_WRITE, 0))) {
+            Log::Error("FSUSER_OpenFile(%s) failed: 0x%x\n", journal_path, ret);
+            Journal::Reset();
+            return;
+        }
+        
+        job = current;
+        header = JournalHeader();
+        header.type = job.type;
+        header.src_archive = Journal::GetArchiveIndex(job.src_archive);
+        header.dest_archive = Journal::GetArchiveIndex(job.dest_archive);
+        header.conflict = job.conflict;
+        active = true;
+        
+        if (!resume)
+            committed.clear();
+            
+        Journal::Write(resume? &resume_manifest : nullptr);
+    }
+    
+    // Marks item as the one in progress, everything before it is finished.
+    void SetItem(u32 item) {
+        if (!active)
+            return;
+            
+        // Begin() has already written the resumed item.
+        if ((resume) && (item == 0))
+            return;
+            
+        resume = false;
+        resume_manifest.Clear();
+        committed.clear();
+        header.item = item;
+        Journal::Write(nullptr);
+    }
+    
+    // Hands out the resumed item's manifest (once), so it is carried on with instead of walked again.
+    bool GetManifest(TreeManifest &manifest) {
+        if ((!active) || (!resume))
+            return false;
+            
+        manifest = std::move(resume_manifest);
+        resume_manifest.Clear();
+        resume = false;
+        return true;
+    }
+    
+    // Records the item's manifest before any of its data is written.
+    void SetManifest(const TreeManifest &manifest) {
+        if (!active)
+            return;
+            
+        committed.assign(manifest.Size(), 0);
+        Journal::Write(&manifest);
+    }
+    
+    bool IsActive(void) {
+        return active;
+    }
+    
+    bool IsComplete(u32 index) {
+        return (index < committed.size()) && (committed[index] == complete);
+    }
+    
+    bool IsSkipped(u32 index) {
+        return (index < committed.size()) && (committed[index] == skipped);
+    }
+    
+    // Bytes of the file at index known to be on the destination already.
+    u64 GetOffset(u32 index) {
+        return ((index < committed.size()) && (committed[index] != complete) && (committed[index] != skipped))? committed[index] : 0;
+    }
+    
+    static void Commit(u32 index, u64 offset) {
+        if ((!active) || (index >= committed.size()))
+            return;
+            
+        committed[index] = offset;
+        dirty_first = dirty? std::min(dirty_first, index) : index;
+        dirty_last = dirty? std::max(dirty_last, index) : index;
+        dirty = true;
+    }
+    
+    // Only takes effect on the next Sync(), the file has to be closed (and so flushed) by then.
+    void Complete(u32 index) {
+        Journal::Commit(index, complete);
+    }
+    
+    // Records that the file at index is to be left alone, with the next Sync().
+    void Skip(u32 index) {
+        Journal::Commit(index, skipped);
+    }
+    
+    // Sets the file the copy engine's checkpoints are for, -1 for none.
+    void SetFile(s32 index) {
+        file = index;
+    }
+    
+    // Called by the copy engine once the destination has been flushed up to offset.
+    void Checkpoint(u64 offset) {
+        if ((!active) || (file < 0))
+            return;
+            
+        Journal::Commit(file, offset);
+        Journal::Sync();
+    }
+    
+    // Writes out the part of the offsets table changed since the last sync.
+    void Sync(void) {
+        if ((!active) || (!dirty))
+            return;
+            
+        Result ret = 0;
+        u32 bytes_written = 0;
+        if (R_FAILED(ret = FSFILE_Write(handle, &bytes_written, header.table_offset + (dirty_first * sizeof(u64)), &committed[dirty_first], 
+            ((dirty_last - dirty_first) + 1) * sizeof(u64), Durability::GetWriteFlags(DurabilityState))))
+            Log::Error("FSFILE_Write(%s) failed: 0x%x\n", journal_path, ret);
+            
+        dirty = false;
+    }
+    
+    // Stops journaling. keep leaves the journal behind to be resumed on the next launch.
+    void End(bool keep) {
+        if (!active)
+            return;
+            
+        Journal::Sync();
+        Durability::Close(DurabilityState, handle, true);
+        handle = 0;
+        active = false;
+        job = Job();
+        Journal::Reset();
+        
+        if (!keep)
+            FSUSER_DeleteFile(sdmc_archive, fsMakePath(PATH_ASCII, journal_path));
+    }
+}
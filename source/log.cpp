@@ -2,59 +2,110 @@
 #include <string>
 
 #include "config.h"
+#include "durability.h"
 #include "fs.h"
 
 namespace Log {
     static Handle handle;
     static u64 offset = 0;
+    static LightLock lock;
+    static bool lock_ready = false;
 
-    Result Open(void) {
+    static Result OpenFile(const std::string &path) {
         Result ret = 0;
-        std::string path = "/3ds/3DShell/debug.log";
 
         // Delete existing logs on start up.
         if (FS::FileExists(sdmc_archive, path))
             FSUSER_DeleteFile(sdmc_archive, fsMakePath(PATH_ASCII, path.c_str()));
 
         if (!FS::FileExists(sdmc_archive, path)) {
-            if (R_FAILED(ret = FSUSER_CreateFile(archive, fsMakePath(PATH_ASCII, path.c_str()), 0, 0)))
+            if (R_FAILED(ret = FSUSER_CreateFile(sdmc_archive, fsMakePath(PATH_ASCII, path.c_str()), 0, 0)))
                 return ret;
         }
         
         if (R_FAILED(ret = FSUSER_OpenFile(&handle, sdmc_archive, fsMakePath(PATH_ASCII, path.c_str()), FS_OPEN_WRITE, 0)))
             return ret;
             
+        offset = 0;
         return 0;
     }
     
+    Result Open(void) {
+        Result ret = 0;
+        std::string path = "/3ds/3DShell/debug.log";
+        
+        // Background jobs log too, so writes are serialised. Open() is called again after a delete, the lock is kept.
+        if (!lock_ready) {
+            LightLock_Init(&lock);
+            lock_ready = true;
+        }
+        
+        LightLock_Lock(&lock);
+        ret = Log::OpenFile(path);
+        LightLock_Unlock(&lock);
+        return ret;
+    }
+    
     Result Close(void) {
         Result ret = 0;
         
-        if (R_FAILED(ret = FSFILE_Close(handle)))
-            return ret;
+        LightLock_Lock(&lock);
+        if (Durability::GetMode(DurabilityLog) != DurabilityChunk)
+            FSFILE_Flush(handle);
             
-        return 0;
+        ret = FSFILE_Close(handle);
+        handle = 0;
+        LightLock_Unlock(&lock);
+        return ret;
+    }
+    
+    // Called once a job is over, the log is only flushed line by line or when closed otherwise.
+    void Flush(void) {
+        if ((!lock_ready) || (Durability::GetMode(DurabilityLog) != DurabilityDeferred))
+            return;
+            
+        LightLock_Lock(&lock);
+        if (handle)
+            FSFILE_Flush(handle);
+            
+        LightLock_Unlock(&lock);
+    }
+
+    static void Write(const char *prefix, const char *data, va_list args) {
+        char buf[256];
+        std::vsnprintf(buf, sizeof(buf), data, args);
+        
+        std::string log_string = prefix;
+        log_string.append(buf);
+        
+        std::printf("%s", log_string.c_str());
+
+        u32 bytes_written = 0;
+        LightLock_Lock(&lock);
+        
+        if (R_SUCCEEDED(FSFILE_Write(handle, &bytes_written, offset, log_string.data(), log_string.length(), Durability::GetWriteFlags(DurabilityLog))))
+            offset += bytes_written;
+            
+        LightLock_Unlock(&lock);
     }
 
     void Error(const char *data, ...) {
         if (!cfg.dev_options)
             return;
         
-        char buf[256];
         va_list args;
         va_start(args, data);
-        std::vsnprintf(buf, sizeof(buf), data, args);
+        Log::Write("[ERROR] ", data, args);
         va_end(args);
-        
-        std::string error_string = "[ERROR] ";
-        error_string.append(buf);
-        
-        std::printf("%s", error_string.c_str());
+    }
 
-        u32 bytes_written = 0;
-        if (R_FAILED(FSFILE_Write(handle, &bytes_written, offset, error_string.data(), error_string.length(), FS_WRITE_FLUSH)))
+    void Debug(const char *data, ...) {
+        if (!cfg.dev_options)
             return;
-            
-        offset += bytes_written;
+        
+        va_list args;
+        va_start(args, data);
+        Log::Write("[DEBUG] ", data, args);
+        va_end(args);
     }
 }
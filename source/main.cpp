@@ -1,11 +1,17 @@
 #include <3ds.h>
 
+#include "buffer_pool.h"
 #include "c2d_helper.h"
 #include "config.h"
 #include "fs.h"
 #include "gui.h"
+#include "io_tune.h"
+#include "jobs.h"
 #include "log.h"
+#include "progress.h"
 #include "textures.h"
+#include "trash.h"
+#include "undo.h"
 #include "utils.h"
 
 std::string __application_path__;
@@ -20,7 +26,17 @@ namespace Services {
         archive = sdmc_archive;
         Log::Open();
         Config::Load();
+        IOTune::Load();
+        BufferPool::Init();
+        Progress::Init();
+        Trash::Init();
+        Undo::Init();
+        Jobs::Init();
         
+        // Lets the copy engine's workers run on the system core, they fall back to the app core if this fails.
+        if (R_FAILED(ret = APT_SetAppCpuTimeLimit(30)))
+            Log::Error("APT_SetAppCpuTimeLimit failed: 0x%x\n", ret);
+            
         if (R_FAILED(ret = acInit())) {
             Log::Error("acInit failed: 0x%x\n", ret);
             return ret;
@@ -69,6 +85,9 @@ namespace Services {
     }
 
     void Exit(void) {
+        Jobs::Exit();
+        Undo::Exit();
+        BufferPool::Exit();
         Textures::Exit();
         C2D_TextBufDelete(size_buf);
         C2D_TextBufDelete(dynamic_buf);
@@ -80,6 +99,7 @@ namespace Services {
         mcuHwcExit();
         amExit();
         acExit();
+        Log::Close();
         FS::CloseArchive(nand_archive);
         FS::CloseArchive(sdmc_archive);
     }
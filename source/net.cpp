@@ -6,6 +6,7 @@
 #include <jansson.h>
 #include <regex>
 
+#include "durability.h"
 #include "fs.h"
 #include "log.h"
 #include "net.h"
@@ -111,7 +112,7 @@ namespace Net {
     }
     
     size_t Write3dsxData(const char *ptr, size_t size, size_t nmemb, Handle *userdata) {
-        if (R_SUCCEEDED(FSFILE_Write(*userdata, nullptr, offset, ptr, (size * nmemb), FS_WRITE_FLUSH)))
+        if (R_SUCCEEDED(FSFILE_Write(*userdata, nullptr, offset, ptr, (size * nmemb), Durability::GetWriteFlags(DurabilityDownload))))
             offset += (size * nmemb);
         
         return (size * nmemb);
@@ -147,7 +148,8 @@ namespace Net {
             curl_easy_cleanup(handle);
         }
         
-        FSFILE_Close(file);
+        // The download is the whole operation, closing it is the end of the job too.
+        Durability::Close(DurabilityDownload, file, true);
         offset = 0;
         return;
     }
@@ -0,0 +1,59 @@
+#include "path_builder.h"
+#include "unicode.h"
+
+// Deep enough for the FS's own 0x106 character names a few levels down without growing.
+static const u32 initial_capacity = 0x400;
+
+PathBuilder::PathBuilder(void) {
+    path.reserve(initial_capacity);
+}
+
+PathBuilder::PathBuilder(const std::string &path) : PathBuilder() {
+    this->Set(path);
+}
+
+PathBuilder::PathBuilder(const std::u16string &path) : PathBuilder() {
+    this->path.append(path);
+}
+
+// Returns the last component.
+const char16_t *PathBuilder::GetName(void) const {
+    std::size_t pos = path.find_last_of(u'/');
+    return &path[(pos == std::u16string::npos)? 0 : pos + 1];
+}
+
+void PathBuilder::Set(const std::string &path) {
+    this->path.resize(path.length());
+    this->path.resize(Unicode::UTF8ToUTF16(this->path.data(), path.length() + 1, path.data(), path.length()));
+}
+
+static void AppendSeparator(std::u16string &path) {
+    if ((!path.empty()) && (path.back() != u'/'))
+        path.push_back(u'/');
+}
+
+u32 PathBuilder::Append(const char16_t *name) {
+    u32 length = path.length();
+    AppendSeparator(path);
+    path.append(name);
+    return length;
+}
+
+u32 PathBuilder::Append(const std::u16string &name) {
+    return this->Append(name.c_str());
+}
+
+u32 PathBuilder::Append(const std::string &name) {
+    u32 length = path.length();
+    AppendSeparator(path);
+    
+    // Convert straight into the buffer, a UTF-8 name never needs more code units than it has bytes.
+    u32 pos = path.length();
+    path.resize(pos + name.length());
+    path.resize(pos + Unicode::UTF8ToUTF16(&path[pos], name.length() + 1, name.data(), name.length()));
+    return length;
+}
+
+std::string PathBuilder::ToUTF8(void) const {
+    return Unicode::ToUTF8(path);
+}
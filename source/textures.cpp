@@ -13,6 +13,7 @@
 // PNG
 #include <png.h>
 
+#include "buffer_pool.h"
 #include "fs.h"
 #include "log.h"
 #include "sprites.h"
@@ -117,7 +118,13 @@ namespace Textures {
             return ret;
         }
         
-        *buffer = new u8[*size];
+        // Images larger than a pool buffer get a one-off allocation, still released through BufferPool::Return.
+        if (!(*buffer = BufferPool::Checkout(static_cast<u32>(*size)))) {
+            Log::Error("BufferPool::Checkout(%s) failed\n", path.c_str());
+            FSFILE_Close(file);
+            return -1;
+        }
+        
         u32 bytes_read = 0;
         
         if (R_FAILED(ret = FSFILE_Read(file, &bytes_read, 0, *buffer, static_cast<u32>(*size)))) {
@@ -341,7 +348,7 @@ namespace Textures {
         u64 size = 0;
         
         if (R_FAILED(Textures::ReadFile(path, &data, &size))) {
-            delete[] data;
+            BufferPool::Return(data);
             return ret;
         }
         
@@ -369,7 +376,7 @@ namespace Textures {
                 break;
         }
         
-        delete[] data;
+        BufferPool::Return(data);
         return ret;
     }
 
@@ -0,0 +1,288 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <jansson.h>
+
+#include "fs.h"
+#include "log.h"
+#include "path_builder.h"
+#include "trash.h"
+#include "tree_walk.h"
+
+#define TRASH_VERSION 1
+
+// Deleting to the trash is a rename into /3ds/3DShell/.trash on the same archive, so it's instant whatever the size.
+// Each archive keeps an index of what its trash holds (where every item came from, its size and when it was deleted)
+// so the trash can be listed without walking it. The index is rewritten whenever it changes, into a temporary file
+// that then replaces it, so there is always a complete copy of it on the archive.
+namespace Trash {
+    typedef struct {
+        std::vector<TrashItem> items;
+        u32 next_id = 1;
+    } TrashIndex;
+    
+    static const std::string trash_dir = "/3ds/3DShell/.trash/";
+    static const std::string index_path = "/3ds/3DShell/.trash/index.json";
+    static const std::string temp_path = "/3ds/3DShell/.trash/index.json.tmp";
+    static const u64 min_free_percent = 5; // below this much free space the oldest items are purged
+    
+    static TrashIndex indexes[2];
+    static LightLock lock; // the index, shared by the UI thread and the jobs worker
+    static LightLock save_lock; // the index file, taken before lock
+    
+    static TrashIndex &GetIndex(FS_Archive archive) {
+        return indexes[archive == nand_archive? 1 : 0];
+    }
+    
+    static Result Load(FS_Archive archive, TrashIndex &index) {
+        Result ret = 0;
+        Handle file;
+        
+        // Only the temporary file is left if the app stopped between removing the old index and renaming the new one.
+        if ((R_FAILED(ret = FSUSER_OpenFile(&file, archive, fsMakePath(PATH_ASCII, index_path.c_str()), FS_OPEN_READ, 0))) && 
+            (R_FAILED(ret = FSUSER_OpenFile(&file, archive, fsMakePath(PATH_ASCII, temp_path.c_str()), FS_OPEN_READ, 0))))
+            return 0;
+            
+        u64 size = 0;
+        if (R_FAILED(ret = FSFILE_GetSize(file, &size))) {
+            FSFILE_Close(file);
+            return ret;
+        }
+        
+        char *buf = new char[size + 1];
+        u32 bytes_read = 0;
+        
+        if (R_FAILED(ret = FSFILE_Read(file, &bytes_read, 0, buf, size))) {
+            FSFILE_Close(file);
+            delete[] buf;
+            return ret;
+        }
+        
+        FSFILE_Close(file);
+        buf[bytes_read] = '\0';
+        
+        json_error_t error;
+        json_t *root = json_loads(buf, JSON_DISABLE_EOF_CHECK, &error);
+        delete[] buf;
+        
+        if (!root) {
+            Log::Error("Failed to decode trash index.json!\n");
+            return -1;
+        }
+        
+        if (json_integer_value(json_object_get(root, "trash_ver")) == TRASH_VERSION) {
+            index.next_id = json_integer_value(json_object_get(root, "next_id"));
+            json_t *items = json_object_get(root, "items");
+            
+            for (std::size_t i = 0; i < json_array_size(items); i++) {
+                json_t *entry = json_array_get(items, i);
+                const char *path = json_string_value(json_object_get(entry, "path"));
+                
+                TrashItem item;
+                item.id = json_integer_value(json_object_get(entry, "id"));
+                item.path = path? path : "";
+                item.dir = json_integer_value(json_object_get(entry, "dir"));
+                item.size = json_integer_value(json_object_get(entry, "size"));
+                item.files = json_integer_value(json_object_get(entry, "files"));
+                item.time = json_integer_value(json_object_get(entry, "time"));
+                index.items.push_back(item);
+                index.next_id = std::max(index.next_id, item.id + 1);
+            }
+        }
+        
+        json_decref(root);
+        return 0;
+    }
+    
+    // The index is serialised under the lock and written out after releasing it, so the trash view never waits on the SD.
+    // save_lock is held throughout, so copies are written in the order they were taken and the newest always wins.
+    static Result Save(FS_Archive archive) {
+        LightLock_Lock(&save_lock);
+        LightLock_Lock(&lock);
+        TrashIndex &index = Trash::GetIndex(archive);
+        json_t *root = json_object();
+        json_t *items = json_array();
+        
+        json_object_set_new(root, "trash_ver", json_integer(TRASH_VERSION));
+        json_object_set_new(root, "next_id", json_integer(index.next_id));
+        
+        for (const TrashItem &item : index.items) {
+            json_t *entry = json_object();
+            json_object_set_new(entry, "id", json_integer(item.id));
+            json_object_set_new(entry, "path", json_string(item.path.c_str()));
+            json_object_set_new(entry, "dir", json_integer(item.dir));
+            json_object_set_new(entry, "size", json_integer(item.size));
+            json_object_set_new(entry, "files", json_integer(item.files));
+            json_object_set_new(entry, "time", json_integer(item.time));
+            json_array_append_new(items, entry);
+        }
+        
+        json_object_set_new(root, "items", items);
+        char *buf = json_dumps(root, JSON_COMPACT);
+        json_decref(root);
+        LightLock_Unlock(&lock);
+        
+        if (!buf) {
+            LightLock_Unlock(&save_lock);
+            return -1;
+        }
+            
+        Result ret = 0;
+        u32 length = std::strlen(buf);
+        FSUSER_DeleteFile(archive, fsMakePath(PATH_ASCII, temp_path.c_str()));
+        FSUSER_CreateFile(archive, fsMakePath(PATH_ASCII, temp_path.c_str()), 0, length);
+        
+        Handle file;
+        if (R_SUCCEEDED(ret = FSUSER_OpenFile(&file, archive, fsMakePath(PATH_ASCII, temp_path.c_str()), FS_OPEN_WRITE, 0))) {
+            u32 bytes_written = 0;
+            if (R_FAILED(ret = FSFILE_Write(file, &bytes_written, 0, buf, length, 0)))
+                Log::Error("FSFILE_Write(%s) failed: 0x%x\n", temp_path.c_str(), ret);
+                
+            // The temporary file has to be on the archive before the old index goes, whatever the durability setting.
+            if ((R_SUCCEEDED(ret)) && (R_FAILED(ret = FSFILE_Flush(file))))
+                Log::Error("FSFILE_Flush(%s) failed: 0x%x\n", temp_path.c_str(), ret);
+                
+            FSFILE_Close(file);
+        }
+        else
+            Log::Error("FSUSER_OpenFile(%s) failed: 0x%x\n", temp_path.c_str(), ret);
+            
+        // A rename can't replace an existing file, the old index is removed first.
+        if (R_SUCCEEDED(ret)) {
+            FSUSER_DeleteFile(archive, fsMakePath(PATH_ASCII, index_path.c_str()));
+            
+            if (R_FAILED(ret = FSUSER_RenameFile(archive, fsMakePath(PATH_ASCII, temp_path.c_str()), archive, fsMakePath(PATH_ASCII, index_path.c_str()))))
+                Log::Error("FSUSER_RenameFile(%s) failed: 0x%x\n", temp_path.c_str(), ret);
+        }
+        
+        LightLock_Unlock(&save_lock);
+        std::free(buf);
+        return ret;
+    }
+    
+    void Init(void) {
+        LightLock_Init(&lock);
+        LightLock_Init(&save_lock);
+        Trash::Load(sdmc_archive, indexes[0]);
+        Trash::Load(nand_archive, indexes[1]);
+    }
+    
+    const std::string &GetDir(void) {
+        return trash_dir;
+    }
+    
+    std::string GetPath(u32 id) {
+        return trash_dir + std::to_string(id);
+    }
+    
+    // Whether path is the trash itself or inside it, deleting there is permanent.
+    bool Contains(const std::string &path) {
+        return (!path.compare(0, trash_dir.length(), trash_dir)) || (!path.compare(trash_dir.substr(0, trash_dir.length() - 1)));
+    }
+    
+    static Result Rename(FS_Archive archive, const std::string &src, const std::string &dest, bool is_dir) {
+        Result ret = 0;
+        PathBuilder src_path(src), dest_path(dest);
+        
+        if (is_dir) {
+            if (R_FAILED(ret = FSUSER_RenameDirectory(archive, src_path.GetPath(), archive, dest_path.GetPath())))
+                Log::Error("FSUSER_RenameDirectory(%s, %s) failed: 0x%x\n", src.c_str(), dest.c_str(), ret);
+        }
+        else {
+            if (R_FAILED(ret = FSUSER_RenameFile(archive, src_path.GetPath(), archive, dest_path.GetPath())))
+                Log::Error("FSUSER_RenameFile(%s, %s) failed: 0x%x\n", src.c_str(), dest.c_str(), ret);
+        }
+        
+        return ret;
+    }
+    
+    // Moves path into the trash and records it. Called from the jobs worker: the item is sized up once it's in the trash,
+    // so the walk never holds up the rename.
+    Result Add(FS_Archive archive, const std::string &path, bool is_dir, u32 *id) {
+        Result ret = 0;
+        FSUSER_CreateDirectory(archive, fsMakePath(PATH_ASCII, "/3ds"), 0);
+        FSUSER_CreateDirectory(archive, fsMakePath(PATH_ASCII, "/3ds/3DShell"), 0);
+        FSUSER_CreateDirectory(archive, fsMakePath(PATH_ASCII, trash_dir.substr(0, trash_dir.length() - 1).c_str()), 0);
+        
+        TrashItem item;
+        item.path = path;
+        item.dir = is_dir;
+        item.time = std::time(nullptr);
+        
+        LightLock_Lock(&lock);
+        item.id = Trash::GetIndex(archive).next_id++;
+        LightLock_Unlock(&lock);
+        *id = item.id;
+        
+        if (R_FAILED(ret = Trash::Rename(archive, path, Trash::GetPath(item.id), is_dir)))
+            return ret;
+            
+        PathBuilder trash_path(Trash::GetPath(item.id));
+        TreeManifest manifest;
+        if (R_SUCCEEDED(TreeWalk::Build(archive, trash_path, is_dir, manifest))) {
+            item.size = manifest.total_bytes;
+            item.files = manifest.num_files;
+        }
+        
+        LightLock_Lock(&lock);
+        Trash::GetIndex(archive).items.push_back(item);
+        LightLock_Unlock(&lock);
+        return Trash::Save(archive);
+    }
+    
+    // Drops an item from the index once it has been purged.
+    void Remove(FS_Archive archive, u32 id) {
+        LightLock_Lock(&lock);
+        std::vector<TrashItem> &items = Trash::GetIndex(archive).items;
+        items.erase(std::remove_if(items.begin(), items.end(), [id](const TrashItem &item) { return item.id == id; }), items.end());
+        LightLock_Unlock(&lock);
+        Trash::Save(archive);
+    }
+    
+    // Puts an item back where it was deleted from. Refused if something has taken its place since.
+    Result Restore(FS_Archive archive, const TrashItem &item) {
+        Result ret = 0;
+        
+        if ((FS::FileExists(archive, item.path)) || (FS::DirExists(archive, item.path))) {
+            Log::Error("Trash::Restore(%s): already exists\n", item.path.c_str());
+            return -1;
+        }
+        
+        if (R_FAILED(ret = Trash::Rename(archive, Trash::GetPath(item.id), item.path, item.dir)))
+            return ret;
+            
+        Trash::Remove(archive, item.id);
+        return 0;
+    }
+    
+    void GetItems(FS_Archive archive, std::vector<TrashItem> &items) {
+        LightLock_Lock(&lock);
+        items = Trash::GetIndex(archive).items;
+        LightLock_Unlock(&lock);
+    }
+    
+    // When free space on archive is low, fills items with the oldest trash items whose purge brings it back up.
+    bool GetPurgeList(FS_Archive archive, std::vector<TrashItem> &items) {
+        FS_SystemMediaType mediatype = archive == nand_archive? SYSTEM_MEDIATYPE_CTR_NAND : SYSTEM_MEDIATYPE_SD;
+        u64 total = FS::GetTotalStorage(mediatype);
+        u64 free = total - FS::GetUsedStorage(mediatype);
+        u64 wanted = (total * min_free_percent) / 100;
+        items.clear();
+        
+        if (free >= wanted)
+            return false;
+            
+        std::vector<TrashItem> trash;
+        Trash::GetItems(archive, trash);
+        std::sort(trash.begin(), trash.end(), [](const TrashItem &a, const TrashItem &b) { return a.time < b.time; });
+        
+        for (u32 i = 0; (i < trash.size()) && (free < wanted); i++) {
+            items.push_back(trash[i]);
+            free += trash[i].size;
+        }
+        
+        return !items.empty();
+    }
+}
@@ -0,0 +1,114 @@
+#include "log.h"
+#include "progress.h"
+#include "tree_walk.h"
+
+void TreeManifest::Clear(void) {
+    paths.clear();
+    path_offsets.clear();
+    sizes.clear();
+    dirs.clear();
+    total_bytes = 0;
+    num_files = 0;
+    num_dirs = 0;
+    errors = 0;
+    result = 0;
+}
+
+void TreeManifest::Add(const std::u16string &path, bool dir, u64 size) {
+    path_offsets.push_back(paths.size());
+    paths.insert(paths.end(), path.begin(), path.end());
+    paths.push_back(u'\0');
+    sizes.push_back(size);
+    dirs.push_back(dir);
+    
+    if (dir)
+        num_dirs++;
+    else {
+        num_files++;
+        total_bytes += size;
+    }
+}
+
+namespace TreeWalk {
+    static const u32 dir_read_batch = 64;
+    
+    // Appends the entries of the directory at root + rel_path. The handle is closed before returning, so however deep
+    // the tree is only one directory is ever open.
+    static Result ReadDir(FS_Archive archive, PathBuilder &root, const std::u16string &rel_path, TreeManifest &manifest) {
+        Result ret = 0;
+        Handle dir;
+        u32 root_length = rel_path.empty()? root.Length() : root.Append(rel_path);
+        
+        if (R_FAILED(ret = FSUSER_OpenDirectory(&dir, archive, root.GetPath()))) {
+            Log::Error("FSUSER_OpenDirectory(%s) failed: 0x%x\n", root.ToUTF8().c_str(), ret);
+            root.Truncate(root_length);
+            return ret;
+        }
+        
+        u32 entry_count = 0;
+        std::u16string path = rel_path;
+        std::vector<FS_DirectoryEntry> batch(dir_read_batch);
+        
+        do {
+            if (R_FAILED(ret = FSDIR_Read(dir, &entry_count, dir_read_batch, batch.data()))) {
+                Log::Error("FSDIR_Read(%s) failed: 0x%x\n", root.ToUTF8().c_str(), ret);
+                break;
+            }
+            
+            for (u32 i = 0; i < entry_count; i++) {
+                if (!rel_path.empty())
+                    path.push_back(u'/');
+                    
+                path.append(reinterpret_cast<const char16_t *>(batch[i].name));
+                manifest.Add(path, batch[i].attributes & FS_ATTRIBUTE_DIRECTORY, batch[i].fileSize);
+                path.resize(rel_path.length());
+            }
+        } while(entry_count > 0);
+        
+        FSDIR_Close(dir);
+        root.Truncate(root_length);
+        return ret;
+    }
+    
+    // The manifest doubles as the work list: entries are visited in order and every directory met is read in turn,
+    // appending its contents to the end. Unreadable directories are counted and skipped rather than ending the walk.
+    Result Build(FS_Archive archive, PathBuilder &root, bool is_dir, TreeManifest &manifest) {
+        Result ret = 0;
+        manifest.Clear();
+        
+        if (!is_dir) {
+            Handle handle;
+            if (R_FAILED(ret = FSUSER_OpenFile(&handle, archive, root.GetPath(), FS_OPEN_READ, 0))) {
+                Log::Error("FSUSER_OpenFile(%s) failed: 0x%x\n", root.ToUTF8().c_str(), ret);
+                return ret;
+            }
+            
+            u64 size = 0;
+            ret = FSFILE_GetSize(handle, &size);
+            FSFILE_Close(handle);
+            
+            if (R_FAILED(ret)) {
+                Log::Error("FSFILE_GetSize(%s) failed: 0x%x\n", root.ToUTF8().c_str(), ret);
+                return ret;
+            }
+            
+            manifest.Add(std::u16string(), false, size);
+            return 0;
+        }
+        
+        if (R_FAILED(ret = TreeWalk::ReadDir(archive, root, std::u16string(), manifest)))
+            return ret;
+            
+        for (u32 i = 0; (i < manifest.Size()) && (!Progress::IsCancelled()); i++) {
+            if (!manifest.IsDir(i))
+                continue;
+                
+            if (R_FAILED(ret = TreeWalk::ReadDir(archive, root, manifest.GetPath(i), manifest))) {
+                if (manifest.errors++ == 0)
+                    manifest.result = ret;
+            }
+        }
+        
+        return 0;
+    }
+}
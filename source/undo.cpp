@@ -0,0 +1,417 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "dir_cache.h"
+#include "durability.h"
+#include "fs.h"
+#include "jobs.h"
+#include "log.h"
+#include "path_builder.h"
+#include "trash.h"
+#include "undo.h"
+#include "unicode.h"
+
+// The last few renames, moves, new entries and deletes to the trash, each recorded as what reverses it. The journal on the
+// SD is append-only text: one line per entry (entries recorded together share a group and are undone together) and a
+// "P" line whenever a group is undone. Lines are buffered and written a batch at a time (flushed as DurabilityState
+// says), so recording costs nothing but a string append; the file is rewritten from memory once it has grown well past the limit.
+namespace Undo {
+    typedef struct {
+        u32 group = 0;
+        UndoEntry entry;
+    } UndoRecord;
+    
+    static const std::string journal_path = "/3ds/3DShell/undo.journal";
+    static const u32 max_groups = 32;
+    static const u32 max_records = 512;
+    static const u32 batch_size = 8;
+    
+    static std::vector<UndoRecord> records;
+    static std::string pending;
+    static u32 pending_count = 0;
+    static u32 file_lines = 0;
+    static u32 next_group = 1;
+    static LightLock lock; // records and pending, the jobs worker records moves
+    static LightLock file_lock;
+    
+    static int GetArchiveIndex(FS_Archive archive) {
+        return archive == nand_archive? 1 : 0;
+    }
+    
+    static FS_Archive GetArchive(int index) {
+        return index == 1? nand_archive : sdmc_archive;
+    }
+    
+    static std::string GetParent(const std::string &path) {
+        return path.substr(0, path.find_last_of('/') + 1);
+    }
+    
+    static std::string GetName(const std::string &path) {
+        return path.substr(path.find_last_of('/') + 1);
+    }
+    
+    static std::string Serialise(const UndoRecord &record) {
+        const UndoEntry &entry = record.entry;
+        char header[64];
+        std::snprintf(header, sizeof(header), "E\t%lu\t%d\t%d\t%d\t%d\t%lu\t", record.group, entry.type, Undo::GetArchiveIndex(entry.src_archive), 
+            Undo::GetArchiveIndex(entry.dest_archive), entry.dir, entry.id);
+            
+        return header + entry.src + "\t" + entry.dest + "\n";
+    }
+    
+    static u32 CountGroups(void) {
+        u32 count = 0;
+        
+        for (u32 i = 0; i < records.size(); i++) {
+            if ((i == 0) || (records[i].group != records[i - 1].group))
+                count++;
+        }
+        
+        return count;
+    }
+    
+    // Drops the oldest groups past the limits. Called with the lock held.
+    static void Trim(void) {
+        while ((!records.empty()) && ((Undo::CountGroups() > max_groups) || (records.size() > max_records))) {
+            u32 group = records.front().group;
+            
+            while ((!records.empty()) && (records.front().group == group))
+                records.erase(records.begin());
+        }
+    }
+    
+    static void PopGroup(u32 group) {
+        records.erase(std::remove_if(records.begin(), records.end(), [group](const UndoRecord &record) { return record.group == group; }), 
+            records.end());
+    }
+    
+    static void Parse(char *line) {
+        if (line[0] == 'P') {
+            Undo::PopGroup(std::strtoul(line + 1, nullptr, 10));
+            return;
+        }
+        
+        char *fields[9] = { nullptr };
+        u32 count = 0;
+        
+        for (char *field = line; (field) && (count < 9); count++) {
+            fields[count] = field;
+            
+            if ((field = std::strchr(field, '\t')))
+                *field++ = '\0';
+        }
+        
+        if ((count < 9) || (fields[0][0] != 'E'))
+            return;
+            
+        UndoRecord record;
+        record.group = std::strtoul(fields[1], nullptr, 10);
+        record.entry.type = static_cast<UndoType>(std::atoi(fields[2]));
+        record.entry.src_archive = Undo::GetArchive(std::atoi(fields[3]));
+        record.entry.dest_archive = Undo::GetArchive(std::atoi(fields[4]));
+        record.entry.dir = std::atoi(fields[5]);
+        record.entry.id = std::strtoul(fields[6], nullptr, 10);
+        record.entry.src = fields[7];
+        record.entry.dest = fields[8];
+        records.push_back(record);
+        next_group = record.group + 1;
+    }
+    
+    void Init(void) {
+        LightLock_Init(&lock);
+        LightLock_Init(&file_lock);
+        
+        Handle file;
+        if (R_FAILED(FSUSER_OpenFile(&file, sdmc_archive, fsMakePath(PATH_ASCII, journal_path.c_str()), FS_OPEN_READ, 0)))
+            return;
+            
+        u64 size = 0;
+        FSFILE_GetSize(file, &size);
+        
+        char *buf = new char[size + 1];
+        u32 bytes_read = 0;
+        FSFILE_Read(file, &bytes_read, 0, buf, size);
+        FSFILE_Close(file);
+        buf[bytes_read] = '\0';
+        
+        // A line cut short by the app exiting mid-write is dropped.
+        for (char *line = buf, *end = nullptr; (end = std::strchr(line, '\n')); line = end + 1) {
+            *end = '\0';
+            Undo::Parse(line);
+            file_lines++;
+        }
+        
+        delete[] buf;
+        Undo::Trim();
+    }
+    
+    void Exit(void) {
+        Undo::Flush();
+    }
+    
+    static Result Write(const std::string &data, bool truncate) {
+        Result ret = 0;
+        Handle file;
+        u64 offset = 0;
+        
+        if (truncate)
+            FSUSER_DeleteFile(sdmc_archive, fsMakePath(PATH_ASCII, journal_path.c_str()));
+            
+        if (R_FAILED(ret = FSUSER_OpenFile(&file, sdmc_archive, fsMakePath(PATH_ASCII, journal_path.c_str()), FS_OPEN_WRITE | FS_OPEN_CREATE, 0))) {
+            Log::Error("FSUSER_OpenFile(%s) failed: 0x%x\n", journal_path.c_str(), ret);
+            return ret;
+        }
+        
+        FSFILE_GetSize(file, &offset);
+        
+        u32 bytes_written = 0;
+        if (R_FAILED(ret = FSFILE_Write(file, &bytes_written, offset, data.c_str(), data.length(), Durability::GetWriteFlags(DurabilityState))))
+            Log::Error("FSFILE_Write(%s) failed: 0x%x\n", journal_path.c_str(), ret);
+            
+        Durability::Close(DurabilityState, file);
+        return ret;
+    }
+    
+    // Writes out whatever is buffered, rewriting the whole journal instead once it's mostly dead lines.
+    void Flush(void) {
+        LightLock_Lock(&file_lock);
+        LightLock_Lock(&lock);
+        
+        if (pending_count == 0) {
+            LightLock_Unlock(&lock);
+            LightLock_Unlock(&file_lock);
+            return;
+        }
+        
+        bool compact = (file_lines + pending_count) > (max_records * 2);
+        std::string data;
+        
+        if (compact) {
+            for (const UndoRecord &record : records)
+                data.append(Undo::Serialise(record));
+                
+            file_lines = records.size();
+        }
+        else {
+            data.swap(pending);
+            file_lines += pending_count;
+        }
+        
+        pending.clear();
+        pending_count = 0;
+        LightLock_Unlock(&lock);
+        
+        Undo::Write(data, compact);
+        LightLock_Unlock(&file_lock);
+    }
+    
+    static void Append(const std::string &line) {
+        pending.append(line);
+        pending_count++;
+    }
+    
+    void Record(const std::vector<UndoEntry> &entries) {
+        if (entries.empty())
+            return;
+            
+        LightLock_Lock(&lock);
+        u32 group = next_group++;
+        
+        for (const UndoEntry &entry : entries) {
+            UndoRecord record;
+            record.group = group;
+            record.entry = entry;
+            records.push_back(record);
+            Undo::Append(Undo::Serialise(record));
+        }
+        
+        Undo::Trim();
+        bool flush = pending_count >= batch_size;
+        LightLock_Unlock(&lock);
+        
+        if (flush)
+            Undo::Flush();
+    }
+    
+    void Record(const UndoEntry &entry) {
+        Undo::Record(std::vector<UndoEntry>(1, entry));
+    }
+    
+    // What the undo button would do, or an empty string if there's nothing to undo.
+    const char *GetLabel(void) {
+        LightLock_Lock(&lock);
+        UndoType type = records.empty()? UndoRename : records.back().entry.type;
+        bool empty = records.empty();
+        LightLock_Unlock(&lock);
+        
+        if (empty)
+            return "";
+            
+        switch (type) {
+            case UndoRename:
+                return "Undo rename";
+            case UndoMove:
+                return "Undo move";
+            case UndoCreate:
+                return "Undo new";
+            case UndoTrash:
+                return "Undo delete";
+        }
+        
+        return "";
+    }
+    
+    static Result Rename(FS_Archive archive, const std::string &src, const std::string &dest, bool dir) {
+        Result ret = 0;
+        PathBuilder src_path(src), dest_path(dest);
+        
+        if (dir) {
+            if (R_FAILED(ret = FSUSER_RenameDirectory(archive, src_path.GetPath(), archive, dest_path.GetPath())))
+                Log::Error("FSUSER_RenameDirectory(%s, %s) failed: 0x%x\n", src.c_str(), dest.c_str(), ret);
+            else
+                DirCache::InvalidateTree(archive, src + "/");
+        }
+        else if (R_FAILED(ret = FSUSER_RenameFile(archive, src_path.GetPath(), archive, dest_path.GetPath())))
+            Log::Error("FSUSER_RenameFile(%s, %s) failed: 0x%x\n", src.c_str(), dest.c_str(), ret);
+            
+        return ret;
+    }
+    
+    // A new entry is only removed while it's still empty, anything put in it since would go with it.
+    static Result Remove(FS_Archive archive, const std::string &path, bool dir) {
+        Result ret = 0;
+        PathBuilder fs_path(path);
+        
+        if (dir) {
+            if (R_FAILED(ret = FSUSER_DeleteDirectory(archive, fs_path.GetPath())))
+                Log::Error("FSUSER_DeleteDirectory(%s) failed: 0x%x\n", path.c_str(), ret);
+                
+            return ret;
+        }
+        
+        Handle file;
+        u64 size = 0;
+        
+        if (R_FAILED(ret = FSUSER_OpenFile(&file, archive, fs_path.GetPath(), FS_OPEN_READ, 0))) {
+            Log::Error("FSUSER_OpenFile(%s) failed: 0x%x\n", path.c_str(), ret);
+            return ret;
+        }
+        
+        FSFILE_GetSize(file, &size);
+        FSFILE_Close(file);
+        
+        if (size != 0) {
+            Log::Error("Undo::Remove(%s): no longer empty\n", path.c_str());
+            return -1;
+        }
+        
+        if (R_FAILED(ret = FSUSER_DeleteFile(archive, fs_path.GetPath())))
+            Log::Error("FSUSER_DeleteFile(%s) failed: 0x%x\n", path.c_str(), ret);
+            
+        return ret;
+    }
+    
+    static Result Restore(const UndoEntry &entry) {
+        std::vector<TrashItem> items;
+        Trash::GetItems(entry.src_archive, items);
+        
+        for (const TrashItem &item : items) {
+            if (item.id == entry.id)
+                return Trash::Restore(entry.src_archive, item);
+        }
+        
+        Log::Error("Undo::Restore(%s): no longer in the trash\n", entry.src.c_str());
+        return -1;
+    }
+    
+    static bool IsBusy(const UndoEntry &entry) {
+        switch (entry.type) {
+            case UndoRename:
+            case UndoMove:
+                return (Jobs::IsBusy(entry.src_archive, entry.src)) || (Jobs::IsBusy(entry.dest_archive, entry.dest));
+            case UndoCreate:
+                return Jobs::IsBusy(entry.src_archive, entry.src);
+            case UndoTrash:
+                return (Jobs::IsBusy(entry.src_archive, entry.src)) || (Jobs::IsBusy(entry.dest_archive, entry.dest));
+        }
+        
+        return false;
+    }
+    
+    // Reverses the newest group, newest entry first. Moves are queued back as a job, everything else is a rename or a
+    // delete done here on the UI thread. Refused while a job still uses any of the paths, the group is dropped otherwise
+    // even if some of it couldn't be reversed.
+    Result Revert(void) {
+        LightLock_Lock(&lock);
+        std::vector<UndoEntry> entries;
+        u32 group = records.empty()? 0 : records.back().group;
+        
+        for (u32 i = records.size(); (i-- > 0) && (records[i].group == group);)
+            entries.push_back(records[i].entry);
+            
+        LightLock_Unlock(&lock);
+        
+        if (entries.empty())
+            return 0;
+            
+        for (const UndoEntry &entry : entries) {
+            if (Undo::IsBusy(entry)) {
+                Log::Error("Undo::Revert(%s): in use by a job\n", entry.src.c_str());
+                return -1;
+            }
+        }
+        
+        Result ret = 0, entry_ret = 0;
+        Job job;
+        job.type = JobMove;
+        job.undoing = true;
+        job.conflict = ConflictSkip; // whatever has since taken an original name is left alone
+        
+        for (const UndoEntry &entry : entries) {
+            switch (entry.type) {
+                case UndoRename:
+                    entry_ret = Undo::Rename(entry.src_archive, entry.dest, entry.src, entry.dir);
+                    break;
+                    
+                case UndoMove:
+                    job.src_archive = entry.dest_archive;
+                    job.src_dir = Undo::GetParent(entry.dest);
+                    job.dest_archive = entry.src_archive;
+                    job.dest_dir = Undo::GetParent(entry.src);
+                    // The item may have been kept alongside under a new name, it goes back under the one it had.
+                    job.AddItem(Unicode::ToUTF16(Undo::GetName(entry.dest)).c_str(), entry.dir);
+                    job.dest_names.push_back(Unicode::ToUTF16(Undo::GetName(entry.src)));
+                    break;
+                    
+                case UndoCreate:
+                    entry_ret = Undo::Remove(entry.src_archive, entry.src, entry.dir);
+                    break;
+                    
+                case UndoTrash:
+                    entry_ret = Undo::Restore(entry);
+                    break;
+            }
+            
+            if (entry.type != UndoMove) {
+                DirCache::Invalidate(entry.src_archive, Undo::GetParent(entry.src));
+                
+                if (!entry.dest.empty())
+                    DirCache::Invalidate(entry.dest_archive, Undo::GetParent(entry.dest));
+            }
+            
+            if ((R_FAILED(entry_ret)) && (R_SUCCEEDED(ret)))
+                ret = entry_ret;
+        }
+        
+        if (!job.names.empty())
+            Jobs::Add(job);
+            
+        LightLock_Lock(&lock);
+        Undo::PopGroup(group);
+        Undo::Append("P\t" + std::to_string(group) + "\n");
+        LightLock_Unlock(&lock);
+        return ret;
+    }
+}
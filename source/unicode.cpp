@@ -0,0 +1,189 @@
+#include <cstring>
+
+#include "unicode.h"
+
+namespace Unicode {
+    static const u32 replacement_char = 0xFFFD;
+    
+    // Converts src_length bytes of UTF-8 into dest, which holds dest_size code units including the terminating NUL.
+    // Malformed sequences, overlong forms and encoded surrogates each become a single U+FFFD. Conversion stops early
+    // (on a code point boundary) if dest is full. Returns the number of code units written, not counting the NUL.
+    u32 UTF8ToUTF16(char16_t *dest, u32 dest_size, const char *src, u32 src_length) {
+        const u8 *in = reinterpret_cast<const u8 *>(src);
+        u32 i = 0, count = 0;
+        
+        if (dest_size == 0)
+            return 0;
+            
+        while (i < src_length) {
+            // ASCII fast path, a word at a time.
+            if (((i + 4) <= src_length) && ((count + 4) < dest_size)) {
+                u32 word = 0;
+                std::memcpy(&word, &in[i], sizeof(word));
+                
+                if ((word & 0x80808080) == 0) {
+                    dest[count] = in[i];
+                    dest[count + 1] = in[i + 1];
+                    dest[count + 2] = in[i + 2];
+                    dest[count + 3] = in[i + 3];
+                    i += 4;
+                    count += 4;
+                    continue;
+                }
+            }
+            
+            u8 c = in[i];
+            u32 code_point = 0, length = 1;
+            u8 min = 0x80, max = 0xBF;
+            
+            if (c < 0x80)
+                code_point = c;
+            else if ((c >= 0xC2) && (c <= 0xDF)) {
+                code_point = c & 0x1F;
+                length = 2;
+            }
+            else if ((c >= 0xE0) && (c <= 0xEF)) {
+                code_point = c & 0x0F;
+                length = 3;
+                min = (c == 0xE0)? 0xA0 : 0x80; // Overlong
+                max = (c == 0xED)? 0x9F : 0xBF; // Surrogates
+            }
+            else if ((c >= 0xF0) && (c <= 0xF4)) {
+                code_point = c & 0x07;
+                length = 4;
+                min = (c == 0xF0)? 0x90 : 0x80; // Overlong
+                max = (c == 0xF4)? 0x8F : 0xBF; // Above U+10FFFF
+            }
+            else
+                code_point = replacement_char;
+                
+            u32 j = 1;
+            for (; j < length; j++) {
+                if ((i + j) >= src_length)
+                    break;
+                    
+                u8 b = in[i + j];
+                if ((j == 1)? ((b < min) || (b > max)) : ((b & 0xC0) != 0x80))
+                    break;
+                    
+                code_point = (code_point << 6) | (b & 0x3F);
+            }
+            
+            // A truncated sequence is replaced as a whole, the byte that broke it starts the next one.
+            if (j < length) {
+                code_point = replacement_char;
+                length = j;
+            }
+            
+            if (code_point >= 0x10000) {
+                if ((count + 2) >= dest_size)
+                    break;
+                    
+                code_point -= 0x10000;
+                dest[count++] = 0xD800 + (code_point >> 10);
+                dest[count++] = 0xDC00 + (code_point & 0x3FF);
+            }
+            else {
+                if ((count + 1) >= dest_size)
+                    break;
+                    
+                dest[count++] = code_point;
+            }
+            
+            i += length;
+        }
+        
+        dest[count] = 0;
+        return count;
+    }
+    
+    // Converts src_length code units of UTF-16 into dest, which holds dest_size bytes including the terminating NUL.
+    // Unpaired surrogates become U+FFFD. Conversion stops early (on a code point boundary) if dest is full.
+    // Returns the number of bytes written, not counting the NUL.
+    u32 UTF16ToUTF8(char *dest, u32 dest_size, const char16_t *src, u32 src_length) {
+        u32 i = 0, count = 0;
+        
+        if (dest_size == 0)
+            return 0;
+            
+        while (i < src_length) {
+            // ASCII fast path, a word (two code units) at a time.
+            if (((i + 2) <= src_length) && ((count + 2) < dest_size)) {
+                u32 word = 0;
+                std::memcpy(&word, &src[i], sizeof(word));
+                
+                if ((word & 0xFF80FF80) == 0) {
+                    dest[count] = src[i];
+                    dest[count + 1] = src[i + 1];
+                    i += 2;
+                    count += 2;
+                    continue;
+                }
+            }
+            
+            u32 code_point = src[i], length = 1;
+            
+            if ((code_point >= 0xD800) && (code_point <= 0xDBFF)) {
+                if (((i + 1) < src_length) && (src[i + 1] >= 0xDC00) && (src[i + 1] <= 0xDFFF)) {
+                    code_point = 0x10000 + ((code_point - 0xD800) << 10) + (src[i + 1] - 0xDC00);
+                    length = 2;
+                }
+                else
+                    code_point = replacement_char;
+            }
+            else if ((code_point >= 0xDC00) && (code_point <= 0xDFFF))
+                code_point = replacement_char;
+                
+            u32 bytes = (code_point < 0x80)? 1 : (code_point < 0x800)? 2 : (code_point < 0x10000)? 3 : 4;
+            if ((count + bytes) >= dest_size)
+                break;
+                
+            switch (bytes) {
+                case 1:
+                    dest[count++] = code_point;
+                    break;
+                    
+                case 2:
+                    dest[count++] = 0xC0 | (code_point >> 6);
+                    dest[count++] = 0x80 | (code_point & 0x3F);
+                    break;
+                    
+                case 3:
+                    dest[count++] = 0xE0 | (code_point >> 12);
+                    dest[count++] = 0x80 | ((code_point >> 6) & 0x3F);
+                    dest[count++] = 0x80 | (code_point & 0x3F);
+                    break;
+                    
+                default:
+                    dest[count++] = 0xF0 | (code_point >> 18);
+                    dest[count++] = 0x80 | ((code_point >> 12) & 0x3F);
+                    dest[count++] = 0x80 | ((code_point >> 6) & 0x3F);
+                    dest[count++] = 0x80 | (code_point & 0x3F);
+                    break;
+            }
+            
+            i += length;
+        }
+        
+        dest[count] = 0;
+        return count;
+    }
+    
+    // A UTF-16 string never has more code units than its UTF-8 form has bytes, so one allocation is enough.
+    std::u16string ToUTF16(const std::string &src) {
+        std::u16string dest(src.length(), 0);
+        dest.resize(Unicode::UTF8ToUTF16(dest.data(), dest.length() + 1, src.data(), src.length()));
+        return dest;
+    }
+    
+    // Every UTF-16 code unit takes at most three bytes of UTF-8 (a surrogate pair takes four).
+    std::string ToUTF8(const char16_t *src, u32 src_length) {
+        std::string dest(src_length * 3, 0);
+        dest.resize(Unicode::UTF16ToUTF8(dest.data(), dest.length() + 1, src, src_length));
+        return dest;
+    }
+    
+    std::string ToUTF8(const std::u16string &src) {
+        return Unicode::ToUTF8(src.data(), src.length());
+    }
+}
@@ -0,0 +1,142 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+#include "buffer_pool.h"
+#include "copy_engine.h"
+#include "durability.h"
+#include "io_tune.h"
+#include "journal.h"
+#include "log.h"
+#include "progress.h"
+
+// Files live in memory, the handle is the index into files. The reader and writer threads only ever touch their own
+// file, so nothing here needs a lock.
+static std::vector<u8> files[3];
+
+Result FSFILE_Read(Handle handle, u32 *bytes_read, u64 offset, void *buffer, u32 size) {
+    const std::vector<u8> &file = files[handle];
+    *bytes_read = (offset < file.size())? static_cast<u32>(std::min<u64>(size, file.size() - offset)) : 0;
+    std::memcpy(buffer, file.data() + offset, *bytes_read);
+    return 0;
+}
+
+Result FSFILE_Write(Handle handle, u32 *bytes_written, u64 offset, const void *buffer, u32 size, u32 flags) {
+    std::vector<u8> &file = files[handle];
+    if (file.size() < offset + size)
+        file.resize(offset + size);
+
+    std::memcpy(file.data() + offset, buffer, size);
+    *bytes_written = size;
+    return 0;
+}
+
+Result FSFILE_GetSize(Handle handle, u64 *size) {
+    *size = files[handle].size();
+    return 0;
+}
+
+Result FSFILE_SetSize(Handle handle, u64 size) {
+    files[handle].resize(size);
+    return 0;
+}
+
+Result FSFILE_Flush(Handle handle) { return 0; }
+
+namespace Log {
+    void Error(const char *data, ...) {}
+    void Debug(const char *data, ...) {}
+}
+
+namespace Durability {
+    u32 GetWriteFlags(DurabilityClass type) { return 0; }
+}
+
+namespace IOTune {
+    u32 GetChunkSize(u32 direction) { return 0x40000; }
+    void Record(u32 direction, u32 chunk_size, u32 bytes, u64 ticks) {}
+}
+
+namespace Journal {
+    bool IsActive(void) { return false; }
+    void Checkpoint(u64 offset) {}
+}
+
+namespace Progress {
+    void SetItem(const std::string &name, u64 size) {}
+    void Add(u64 bytes) {}
+    bool IsCancelled(void) { return false; }
+}
+
+// Runs CopyEngine::Copy between in memory files and checks the destination ends up byte for byte the source, whatever
+// was on it before.
+namespace CopyEngineTest {
+    static const Handle src = 1, dest = 2;
+    static unsigned int failures = 0;
+
+    static void Check(bool ok, const char *name) {
+        if (ok)
+            return;
+
+        std::printf("FAIL: %s\n", name);
+        failures++;
+    }
+
+    static std::vector<u8> RandomData(u64 size, std::mt19937 &rng) {
+        std::vector<u8> data(size);
+        for (u8 &byte : data)
+            byte = static_cast<u8>(rng());
+
+        return data;
+    }
+
+    static void Copy(const char *name, u64 offset) {
+        u32 crc = 0;
+        CopyStats stats;
+        Result ret = CopyEngine::Copy(src, dest, offset, files[src].size(), 0, name, &crc, &stats);
+
+        std::printf("%-40s copied %lu of %lu bytes\n", name, static_cast<unsigned long>(stats.bytes), static_cast<unsigned long>(files[src].size()));
+        CopyEngineTest::Check(R_SUCCEEDED(ret), name);
+        CopyEngineTest::Check(files[dest].size() == files[src].size(), name);
+        CopyEngineTest::Check(files[dest] == files[src], name);
+        CopyEngineTest::Check(crc == crc32(crc32(0, nullptr, 0), files[src].data() + offset, files[src].size() - offset), name);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    std::mt19937 rng(0x3D5);
+    BufferPool::Init();
+
+    files[CopyEngineTest::src] = CopyEngineTest::RandomData(0x123457, rng);
+    files[CopyEngineTest::dest].clear();
+    CopyEngineTest::Copy("new file", 0);
+
+    files[CopyEngineTest::dest].assign(0x300000, 0xAA);
+    CopyEngineTest::Copy("overwrites a larger file", 0);
+
+    files[CopyEngineTest::dest].assign(0x1000, 0xAA);
+    CopyEngineTest::Copy("overwrites a smaller file", 0);
+
+    // A resumed copy keeps what is already on dest before the offset.
+    files[CopyEngineTest::dest].assign(files[CopyEngineTest::src].begin(), files[CopyEngineTest::src].begin() + 0x80000);
+    files[CopyEngineTest::dest].resize(0x300000, 0xAA);
+    CopyEngineTest::Copy("resumes over a larger file", 0x80000);
+
+    files[CopyEngineTest::src].clear();
+    files[CopyEngineTest::dest].assign(0x1000, 0xAA);
+    CopyEngineTest::Copy("overwrites with an empty file", 0);
+
+    BufferPool::Exit();
+
+    if (CopyEngineTest::failures > 0) {
+        std::printf("%u checks failed\n", CopyEngineTest::failures);
+        return 1;
+    }
+
+    std::printf("all checks passed\n");
+    return 0;
+}
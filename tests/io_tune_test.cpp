@@ -0,0 +1,118 @@
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <string>
+
+#include "durability.h"
+#include "fs.h"
+#include "io_tune.h"
+#include "log.h"
+
+FS_Archive archive = 1, sdmc_archive = 1, nand_archive = 2;
+
+// Saving is the only I/O IOTune does once probing is over, so a settled direction shows up as an attempt to open the file.
+static unsigned int saves = 0;
+
+FS_Path fsMakePath(u32 type, const void *path) { return FS_Path { type, 0, path }; }
+Result FSUSER_OpenFile(Handle *out, FS_Archive archive, FS_Path path, u32 flags, u32 attributes) { saves++; return -1; }
+Result FSUSER_CreateFile(FS_Archive archive, FS_Path path, u32 attributes, u64 size) { return 0; }
+Result FSUSER_DeleteFile(FS_Archive archive, FS_Path path) { return 0; }
+Result FSFILE_Read(Handle handle, u32 *bytes_read, u64 offset, void *buffer, u32 size) { return -1; }
+Result FSFILE_Write(Handle handle, u32 *bytes_written, u64 offset, const void *buffer, u32 size, u32 flags) { return -1; }
+Result FSFILE_GetSize(Handle handle, u64 *size) { return -1; }
+Result FSFILE_Close(Handle handle) { return 0; }
+
+namespace FS {
+    bool FileExists(FS_Archive archive, const std::string &path) { return false; }
+}
+
+namespace Log {
+    void Error(const char *data, ...) {}
+    void Debug(const char *data, ...) {}
+}
+
+namespace Durability {
+    u32 GetWriteFlags(DurabilityClass type) { return 0; }
+    Result Close(DurabilityClass type, Handle handle, bool job_end) { return FSFILE_Close(handle); }
+}
+
+// Feeds IOTune the way the copy engine does: the reader asks for chunk sizes up to ring_size chunks ahead of the
+// writer, and the writer records each chunk with the bytes it actually moved, short for the last chunk of a file.
+namespace IOTuneTest {
+    static const unsigned int ring_size = 4;
+    static unsigned int failures = 0;
+
+    static void Check(bool ok, const char *name) {
+        if (ok)
+            return;
+
+        std::printf("FAIL: %s\n", name);
+        failures++;
+    }
+
+    // A fixed cost per chunk plus 8 MB/s, so bigger chunks win once files are big enough to fill them.
+    static u64 GetTicks(u32 bytes) {
+        return (SYSCLOCK_ARM11 / 500) + ((static_cast<u64>(bytes) * SYSCLOCK_ARM11) / (8 * 1024 * 1024));
+    }
+
+    static void CopyFile(u32 direction, u64 size) {
+        std::deque<u32> in_flight;
+        u64 requested = 0, offset = 0;
+
+        while (offset < size) {
+            while ((requested < size) && (in_flight.size() < ring_size)) {
+                u32 chunk_size = IOTune::GetChunkSize(direction);
+                in_flight.push_back(chunk_size);
+                requested += chunk_size;
+            }
+
+            u32 chunk_size = in_flight.front();
+            in_flight.pop_front();
+            u32 bytes = static_cast<u32>(std::min<u64>(chunk_size, size - offset));
+            IOTune::Record(direction, chunk_size, bytes, IOTuneTest::GetTicks(bytes));
+            offset += bytes;
+        }
+    }
+
+    // Returns how many files it took for direction to settle (and be saved), or 0 if it never did.
+    static unsigned int Run(u32 direction, u64 file_size, unsigned int max_files) {
+        for (unsigned int i = 1; i <= max_files; i++) {
+            unsigned int saved = saves;
+            IOTuneTest::CopyFile(direction, file_size);
+            IOTune::Save();
+
+            if (saves != saved)
+                return i;
+        }
+
+        return 0;
+    }
+
+    static void Converges(const char *name, u32 direction, u64 file_size, unsigned int max_files) {
+        unsigned int files = IOTuneTest::Run(direction, file_size, max_files);
+        std::printf("%-32s settled after %u files on 0x%lx\n", name, files, static_cast<unsigned long>(IOTune::GetChunkSize(direction)));
+        IOTuneTest::Check(files > 0, name);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    IOTune::Load();
+
+    // Files just past the small file batching, and ones smaller than every candidate but the first.
+    IOTuneTest::Converges("65 KiB files", 0, 0x10400, 200);
+    IOTuneTest::Converges("100 KiB files", 1, 100 * 1024, 200);
+    IOTuneTest::Converges("8 MiB files", 2, 8 * 1024 * 1024, 10);
+
+    u32 settled = IOTune::GetChunkSize(2);
+    IOTuneTest::Check(settled == 0x80000, "large files settle on the largest chunk");
+    IOTuneTest::CopyFile(2, 8 * 1024 * 1024);
+    IOTuneTest::Check(IOTune::GetChunkSize(2) == settled, "settled size is kept");
+
+    if (IOTuneTest::failures > 0) {
+        std::printf("%u checks failed\n", IOTuneTest::failures);
+        return 1;
+    }
+
+    std::printf("all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,111 @@
+#ifndef _3D_SHELL_TESTS_STUB_3DS_H
+#define _3D_SHELL_TESTS_STUB_3DS_H
+
+// Just the parts of libctru the host tested modules use.
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+typedef s32 Result;
+typedef u32 Handle;
+typedef u64 FS_Archive;
+
+#define R_FAILED(res) ((res) < 0)
+#define R_SUCCEEDED(res) ((res) >= 0)
+#define SYSCLOCK_ARM11 268111856ULL
+#define U64_MAX UINT64_MAX
+#define CUR_THREAD_HANDLE 0xFFFF8000
+
+enum { PATH_ASCII = 3, PATH_UTF16 = 4 };
+enum { FS_OPEN_READ = 1, FS_OPEN_WRITE = 2, FS_OPEN_CREATE = 4 };
+enum { FS_WRITE_FLUSH = 1 };
+
+typedef struct {
+    u32 type;
+    u32 size;
+    const void *data;
+} FS_Path;
+
+// Threads and their locks map onto the standard library, so the copy engine's pipeline runs for real.
+typedef struct {
+    std::mutex mutex;
+} LightLock;
+
+typedef struct {
+    std::mutex mutex;
+    std::condition_variable cond;
+    s32 count;
+} LightSemaphore;
+
+typedef void (*ThreadFunc)(void *);
+typedef std::thread *Thread;
+
+inline void LightLock_Init(LightLock *lock) {}
+inline void LightLock_Lock(LightLock *lock) { lock->mutex.lock(); }
+inline void LightLock_Unlock(LightLock *lock) { lock->mutex.unlock(); }
+
+inline void LightSemaphore_Init(LightSemaphore *semaphore, s16 initial_count, s16 max_count) {
+    semaphore->count = initial_count;
+}
+
+inline void LightSemaphore_Acquire(LightSemaphore *semaphore, s32 count) {
+    std::unique_lock<std::mutex> guard(semaphore->mutex);
+    semaphore->cond.wait(guard, [&]() { return semaphore->count >= count; });
+    semaphore->count -= count;
+}
+
+inline void LightSemaphore_Release(LightSemaphore *semaphore, s32 count) {
+    std::lock_guard<std::mutex> guard(semaphore->mutex);
+    semaphore->count += count;
+    semaphore->cond.notify_all();
+}
+
+inline Thread threadCreate(ThreadFunc entrypoint, void *arg, std::size_t stack_size, int prio, int core_id, bool detached) {
+    return new std::thread(entrypoint, arg);
+}
+
+inline Result threadJoin(Thread thread, u64 timeout_ns) {
+    thread->join();
+    return 0;
+}
+
+inline void threadFree(Thread thread) { delete thread; }
+
+inline Result svcGetThreadPriority(s32 *out, Handle handle) {
+    *out = 0x30;
+    return 0;
+}
+
+inline u64 svcGetSystemTick(void) {
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now().time_since_epoch();
+    return static_cast<u64>(elapsed.count() * SYSCLOCK_ARM11);
+}
+
+inline u64 osGetTime(void) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Defined by the test that needs them.
+FS_Path fsMakePath(u32 type, const void *path);
+Result FSUSER_OpenFile(Handle *out, FS_Archive archive, FS_Path path, u32 flags, u32 attributes);
+Result FSUSER_CreateFile(FS_Archive archive, FS_Path path, u32 attributes, u64 size);
+Result FSUSER_DeleteFile(FS_Archive archive, FS_Path path);
+Result FSFILE_Read(Handle handle, u32 *bytes_read, u64 offset, void *buffer, u32 size);
+Result FSFILE_Write(Handle handle, u32 *bytes_written, u64 offset, const void *buffer, u32 size, u32 flags);
+Result FSFILE_GetSize(Handle handle, u64 *size);
+Result FSFILE_SetSize(Handle handle, u64 size);
+Result FSFILE_Flush(Handle handle);
+Result FSFILE_Close(Handle handle);
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef _3D_SHELL_TESTS_STUB_FS_H
+#define _3D_SHELL_TESTS_STUB_FS_H
+
+// Stands in for include/fs.h, which pulls in most of the app.
+#include <3ds.h>
+#include <string>
+
+extern FS_Archive archive, sdmc_archive, nand_archive;
+
+namespace FS {
+    bool FileExists(FS_Archive archive, const std::string &path);
+}
+
+#endif
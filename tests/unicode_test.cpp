@@ -0,0 +1,180 @@
+#include <chrono>
+#include <codecvt>
+#include <cstdio>
+#include <locale>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "unicode.h"
+
+// Checks Unicode:: against hand worked reference data and against std::wstring_convert (what the file system code
+// used before) on random valid text, then times both on path-like strings.
+namespace UnicodeTest {
+    typedef std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t> Codecvt;
+
+    static const u32 path_size = 0x400; // FS_MAX_PATH sized buffers, as the listing code uses
+    static u32 failures = 0;
+
+    static void Check(bool ok, const char *name) {
+        if (ok)
+            return;
+
+        std::printf("FAIL: %s\n", name);
+        failures++;
+    }
+
+    static void CheckToUTF16(const char *name, const std::string &src, const std::u16string &expected) {
+        UnicodeTest::Check(Unicode::ToUTF16(src) == expected, name);
+    }
+
+    static void CheckToUTF8(const char *name, const std::u16string &src, const std::string &expected) {
+        UnicodeTest::Check(Unicode::ToUTF8(src) == expected, name);
+    }
+
+    static void Reference(void) {
+        UnicodeTest::CheckToUTF16("ascii", "/3ds/3DShell", u"/3ds/3DShell");
+        UnicodeTest::CheckToUTF16("two byte", "\xC3\xA9", u"é");
+        UnicodeTest::CheckToUTF16("three byte", "\xE2\x82\xAC", u"€");
+        UnicodeTest::CheckToUTF16("surrogate pair", "\xF0\x9F\x98\x80", u"\xD83D\xDE00");
+        UnicodeTest::CheckToUTF16("highest code point", "\xF4\x8F\xBF\xBF", u"\xDBFF\xDFFF");
+        UnicodeTest::CheckToUTF16("invalid lead", "\xC0\xAF", u"��");
+        UnicodeTest::CheckToUTF16("lead past U+10FFFF", "\xF5" "a", u"�a");
+        UnicodeTest::CheckToUTF16("stray continuation", "a\x80" "b", u"a�b");
+        UnicodeTest::CheckToUTF16("overlong three byte", "\xE0\x80\xAF", u"���");
+        UnicodeTest::CheckToUTF16("overlong four byte", "\xF0\x8F\xBF\xBF", u"����");
+        UnicodeTest::CheckToUTF16("encoded surrogate", "\xED\xA0\x80", u"���");
+        UnicodeTest::CheckToUTF16("above U+10FFFF", "\xF4\x90\x80\x80", u"����");
+        UnicodeTest::CheckToUTF16("truncated mid string", "\xE2\x82" "A", u"�A");
+        UnicodeTest::CheckToUTF16("truncated at end", "a\xF0\x9F\x98", u"a�");
+        UnicodeTest::CheckToUTF16("fast path then multibyte", "abcdefgh\xC3\xA9", u"abcdefghé");
+
+        UnicodeTest::CheckToUTF8("ascii", u"/3ds/3DShell", "/3ds/3DShell");
+        UnicodeTest::CheckToUTF8("two byte", u"é", "\xC3\xA9");
+        UnicodeTest::CheckToUTF8("three byte", u"€", "\xE2\x82\xAC");
+        UnicodeTest::CheckToUTF8("surrogate pair", u"\xD83D\xDE00", "\xF0\x9F\x98\x80");
+        UnicodeTest::CheckToUTF8("lone high surrogate", u"\xD83D" "A", "\xEF\xBF\xBD" "A");
+        UnicodeTest::CheckToUTF8("lone low surrogate", u"\xDE00", "\xEF\xBF\xBD");
+        UnicodeTest::CheckToUTF8("high surrogate at end", u"ab\xD83D", "ab\xEF\xBF\xBD");
+        UnicodeTest::CheckToUTF8("reversed pair", u"\xDE00\xD83D", "\xEF\xBF\xBD\xEF\xBF\xBD");
+    }
+
+    // Output stops on a code point boundary when the buffer fills, a surrogate pair is never split.
+    static void Limits(void) {
+        char16_t utf16[path_size];
+        char utf8[path_size];
+
+        std::string ascii(path_size - 1, 'a');
+        UnicodeTest::Check(Unicode::UTF8ToUTF16(utf16, path_size, ascii.data(), ascii.length()) == path_size - 1, "utf16 fills 0x400");
+
+        ascii.push_back('a');
+        UnicodeTest::Check(Unicode::UTF8ToUTF16(utf16, path_size, ascii.data(), ascii.length()) == path_size - 1, "utf16 truncates at 0x400");
+        UnicodeTest::Check(utf16[path_size - 1] == 0, "utf16 NUL at 0x400");
+
+        std::string pair_fits = std::string(path_size - 3, 'a') + "\xF0\x9F\x98\x80";
+        UnicodeTest::Check(Unicode::UTF8ToUTF16(utf16, path_size, pair_fits.data(), pair_fits.length()) == path_size - 1, "utf16 pair fits");
+        UnicodeTest::Check((utf16[path_size - 3] == 0xD83D) && (utf16[path_size - 2] == 0xDE00), "utf16 pair at end");
+
+        std::string pair_split = std::string(path_size - 2, 'a') + "\xF0\x9F\x98\x80";
+        UnicodeTest::Check(Unicode::UTF8ToUTF16(utf16, path_size, pair_split.data(), pair_split.length()) == path_size - 2, "utf16 pair not split");
+        UnicodeTest::Check(utf16[path_size - 2] == 0, "utf16 NUL before pair");
+
+        std::u16string wide(path_size, u'a');
+        UnicodeTest::Check(Unicode::UTF16ToUTF8(utf8, path_size, wide.data(), wide.length()) == path_size - 1, "utf8 truncates at 0x400");
+        UnicodeTest::Check(utf8[path_size - 1] == 0, "utf8 NUL at 0x400");
+
+        std::u16string multibyte = std::u16string(path_size - 4, u'a') + u"€";
+        UnicodeTest::Check(Unicode::UTF16ToUTF8(utf8, path_size, multibyte.data(), multibyte.length()) == path_size - 1, "utf8 sequence fits");
+
+        multibyte = std::u16string(path_size - 3, u'a') + u"€";
+        UnicodeTest::Check(Unicode::UTF16ToUTF8(utf8, path_size, multibyte.data(), multibyte.length()) == path_size - 3, "utf8 sequence not split");
+
+        UnicodeTest::Check(Unicode::UTF8ToUTF16(utf16, 0, "a", 1) == 0, "utf16 empty buffer");
+        UnicodeTest::Check(Unicode::UTF16ToUTF8(utf8, 0, u"a", 1) == 0, "utf8 empty buffer");
+    }
+
+    // Any scalar value, weighted towards ASCII the way names are.
+    static std::u16string RandomString(std::mt19937 &rng) {
+        std::uniform_int_distribution<u32> length(0, 64), kind(0, 9), bmp(0x80, 0xFFFF), astral(0x10000, 0x10FFFF), ascii(0x20, 0x7E);
+        std::u16string str;
+
+        for (u32 i = 0, count = length(rng); i < count; i++) {
+            u32 k = kind(rng);
+            u32 code_point = (k < 6)? ascii(rng) : (k < 9)? bmp(rng) : astral(rng);
+
+            if ((code_point >= 0xD800) && (code_point <= 0xDFFF))
+                code_point = 0xE000;
+
+            if (code_point >= 0x10000) {
+                code_point -= 0x10000;
+                str.push_back(0xD800 + (code_point >> 10));
+                str.push_back(0xDC00 + (code_point & 0x3FF));
+            }
+            else
+                str.push_back(code_point);
+        }
+
+        return str;
+    }
+
+    static void Conformance(void) {
+        Codecvt codecvt;
+        std::mt19937 rng(0x3D5);
+        u32 mismatches = 0;
+
+        for (u32 i = 0; i < 200000; i++) {
+            std::u16string utf16 = UnicodeTest::RandomString(rng);
+            std::string utf8 = codecvt.to_bytes(utf16);
+
+            if ((Unicode::ToUTF8(utf16) != utf8) || (Unicode::ToUTF16(utf8) != codecvt.from_bytes(utf8)))
+                mismatches++;
+        }
+
+        std::printf("conformance: %lu mismatches against codecvt in 200000 strings\n", static_cast<unsigned long>(mismatches));
+        UnicodeTest::Check(mismatches == 0, "conformance with codecvt");
+    }
+
+    template<typename Func> static double Time(Func func, u32 iterations) {
+        auto start = std::chrono::steady_clock::now();
+
+        for (u32 i = 0; i < iterations; i++)
+            func();
+
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count() / iterations;
+    }
+
+    // Timings are only reported, they depend on the host too much to fail on.
+    static void Benchmark(void) {
+        const std::string paths[] = { "/3ds/3DShell/config.json", "/Nintendo 3DS/private/photos/HNI_0001.JPG", "/music/Sigur R\xC3\xB3s/\xC3\x81g\xC3\xA6tis byrjun.mp3" };
+        const u32 iterations = 200000;
+        Codecvt codecvt;
+        volatile std::size_t sink = 0;
+
+        for (const std::string &path : paths) {
+            std::u16string wide = Unicode::ToUTF16(path);
+            double ours_16 = UnicodeTest::Time([&]() { sink = sink + Unicode::ToUTF16(path).length(); }, iterations);
+            double codecvt_16 = UnicodeTest::Time([&]() { Codecvt convert; sink = sink + convert.from_bytes(path).length(); }, iterations);
+            double ours_8 = UnicodeTest::Time([&]() { sink = sink + Unicode::ToUTF8(wide).length(); }, iterations);
+            double codecvt_8 = UnicodeTest::Time([&]() { Codecvt convert; sink = sink + convert.to_bytes(wide).length(); }, iterations);
+
+            std::printf("%-48s to UTF-16 %6.0f ns (codecvt %6.0f ns), to UTF-8 %6.0f ns (codecvt %6.0f ns)\n", path.c_str(), ours_16, codecvt_16,
+                ours_8, codecvt_8);
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    UnicodeTest::Reference();
+    UnicodeTest::Limits();
+    UnicodeTest::Conformance();
+    UnicodeTest::Benchmark();
+
+    if (UnicodeTest::failures > 0) {
+        std::printf("%lu checks failed\n", static_cast<unsigned long>(UnicodeTest::failures));
+        return 1;
+    }
+
+    std::printf("all checks passed\n");
+    return 0;
+}